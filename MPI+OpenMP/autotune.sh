@@ -0,0 +1,61 @@
+#!/bin/sh
+# Times short trial runs of mpi_omp_heat2Dn over every tasks x threads split
+# of the given number of cores, every schedule, cyclic chunk size and tile
+# grid, and writes the fastest configuration to heat2D.tune. Later runs in
+# the same directory load heat2D.tune automatically (arguments override it)
+# and run.sh starts them with the tuned number of tasks.
+# usage: ./autotune.sh [cores] [trial steps] [input file]
+
+CORES=${1:-$(nproc)}
+STEPS=${2:-20}
+INPUT=${3:-../initial.dat}
+TUNEFILE=heat2D.tune
+CHUNKS="1 6 64"
+
+make -s mpi_omp_heat2Dn || exit 1
+
+# Prints the time of the slowest process, or nothing if the run failed
+trial() {
+    mpirun -n $1 ./mpi_omp_heat2Dn -t $2 -k $STEPS -i $INPUT -o tune.dat $3 2>/dev/null |
+        awk '/Elapsed time/ { n++; if ($4+0 > max) max = $4+0 } END { if (n) printf "%e\n", max }'
+}
+
+best=""
+for ranks in $(seq $CORES); do
+    [ $((CORES % ranks)) -eq 0 ] || continue
+    threads=$((CORES / ranks))
+
+    configs=""
+    for chunk in $CHUNKS; do
+        configs="$configs cyclic:$chunk:0"
+    done
+    for tilerows in $(seq $threads); do
+        [ $((threads % tilerows)) -eq 0 ] || continue
+        configs="$configs tile:1:$tilerows p2p:1:$tilerows part:1:$tilerows"
+    done
+
+    for config in $configs; do
+        schedule=${config%%:*}
+        rest=${config#*:}
+        chunk=${rest%%:*}
+        tilerows=${rest#*:}
+
+        time=$(trial $ranks $threads "-s $schedule -c $chunk -g $tilerows")
+        [ -n "$time" ] || continue
+        echo "tasks=$ranks threads=$threads schedule=$schedule chunk=$chunk tilerows=$tilerows: $time secs"
+
+        if [ -z "$best" ] || awk "BEGIN { exit !($time < $best) }"; then
+            best=$time
+            printf "ranks %d\nthreads %d\nschedule %s\nchunk %d\ntilerows %d\n" \
+                $ranks $threads $schedule $chunk $tilerows > $TUNEFILE
+        fi
+    done
+done
+rm -f tune.dat
+
+if [ -z "$best" ]; then
+    echo "ERROR: no trial run succeeded"
+    exit 1
+fi
+echo "Best configuration ($best secs) written to $TUNEFILE:"
+cat $TUNEFILE
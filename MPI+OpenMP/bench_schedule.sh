@@ -0,0 +1,21 @@
+#!/bin/sh
+# Compares the element-cyclic OpenMP scheduling (-s cyclic) with the
+# thread-private tiles, synchronized with barriers (-s tile), only with
+# their neighbor tiles (-s p2p), or p2p with every edge tile sending its own
+# part of the halo (-s part). Prints the slowest process time of every run.
+# usage: ./bench_schedule.sh [tasks] [threads] [repetitions] [input file]
+
+TASKS=${1:-4}
+THREADS=${2:-4}
+REPS=${3:-5}
+INPUT=${4:-../initial.dat}
+
+make -s mpi_omp_heat2Dn || exit 1
+
+for sched in cyclic tile p2p part; do
+    for rep in $(seq $REPS); do
+        mpirun -n $TASKS ./mpi_omp_heat2Dn -t $THREADS -s $sched -i $INPUT -o bench.dat |
+            awk -v s=$sched '/Elapsed time/ { if ($4+0 > max) max = $4+0 } END { printf "%-7s %e secs\n", s, max }'
+    done
+done
+rm -f bench.dat
@@ -24,6 +24,8 @@
 
 #include "mpi.h"
 #include <omp.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,21 +33,52 @@
 
 #define NXPROB      80                /* x dimension of problem grid */
 #define NYPROB      64                /* y dimension of problem grid */
-#define STEPS       100                /* number of time steps */
+#define STEPS       100                /* default number of time steps */
 #define BEGIN       1                  /* message tag */
 #define LTAG        2                  /* message tag */
 #define RTAG        3                  /* message tag */
 #define NONE        0                  /* indicates no neighbor */
 #define DONE        4                  /* message tag */
 #define MASTER      0                  /* taskid of first process */
+#define CYCLIC      0                  /* element-cyclic omp for scheduling */
+#define TILE        1                  /* every thread owns a 2D tile of the block */
+#define P2P         2                  /* tiles, synchronized only with their neighbor tiles */
+#define PART        3                  /* p2p, and every edge tile sends its own part of the halo */
+#define PTAG        5                  /* message tag of the halo parts (plus the part with MPI-3) */
+#define TUNEFILE    "heat2D.tune"      /* configuration written by autotune.sh */
 
 struct Parms { 
   float cx;
   float cy;
 } parms = {0.1, 0.1};
 
+int chunk = 1;                         /* chunk size of the cyclic schedule */
+
+/* Rectangle of the block that is owned by one thread (inclusive bounds, 1..rows x 1..columns) */
+struct Tile {
+  int x0, x1;
+  int y0, y1;
+};
+
+/* One side of the halo exchange of one of the two arrays in the part schedule. The edge is cut
+ * into parts, one for every tile along it, the same way findTile cuts the block. With MPI-4 it is
+ * a partitioned request with a partition per cell and a tile marks its cells with MPI_Pready_range.
+ * Otherwise every part is a message of its own that the tile sends itself. */
+struct Edge {
+  MPI_Request req;              /* the partitioned request (MPI-4) */
+  MPI_Request *part;            /* a request per part (MPI-3) */
+  float *buf;                   /* first cell of the edge or of the halo */
+  MPI_Datatype cell;            /* datatype of one cell */
+  int stride;                   /* floats between two cells */
+  int cells, parts;
+  int peer, send;
+  MPI_Comm comm;
+};
+
 void inidat(), prtdat(), updateExternal(), updateInternal(),  myprint(), DUMMYDUMDUM();
-int malloc2darr(),free2darr(),isPrime(),isIdentical(), checkSize();
+void findTile(), updateRegion(), updateInternalTile(), updateExternalTile(), waitFor();
+void edgeInit(), edgeStart(), edgeReady(), edgeArrived(), edgeWait(), edgeFree();
+int malloc2darr(),free2darr(),isPrime(),isIdentical(), isIdenticalTile(), checkSize(), scheduleOf(), loadTune();
 
 int main (int argc, char *argv[]){
 
@@ -57,6 +90,13 @@ int main (int argc, char *argv[]){
         msgtype,                    /* for message types */
         xdim, ydim,                 /* dimensions of grid partition (e.x. 4x4) */
         thread_count=1,
+        schedule=P2P,               /* how the block is shared among the threads */
+        tx=1, ty=1,                 /* dimensions of the thread tile grid (e.x. 2x2) */
+        tilerows=0,                 /* tx asked by the user, 0 to choose it like the block grid */
+        steps=STEPS,                /* number of time steps */
+        tuned_ranks=0,              /* number of tasks the tune file was found with */
+        tuned=0,
+        gotthreads=0, gotrows=0,    /* -t and -g were given */
         rows, columns,              /* number of rows/columns of each block (e.x. 20x12) */
         i,j,x,y,ix,iy,iz,        /* loop variables */
         provided;
@@ -65,8 +105,13 @@ int main (int argc, char *argv[]){
     char outputfile[80] = "final.dat";
     MPI_Status status;
 
-    /* Read arguments */
+    /* Load the tuned configuration if there is one. Arguments override it. */
     char flag = 0; 
+    tuned = loadTune(TUNEFILE, &tuned_ranks, &thread_count, &schedule, &tilerows);
+    if (tuned)
+        flag = 1;
+
+    /* Read arguments */
     for(i=1; i<argc; i++){
         if(!strcmp(argv[i],"-i"))
             strcpy(inputfile,argv[i+1]);
@@ -74,9 +119,28 @@ int main (int argc, char *argv[]){
             strcpy(outputfile,argv[i+1]);
         if(!strcmp(argv[i],"-t")){
             thread_count = strtol(argv[i+1], NULL, 10);
+            gotthreads = 1;
             flag = 1;
         }
+        if(!strcmp(argv[i],"-s")){
+            schedule = scheduleOf(argv[i+1]);
+            if (schedule < 0){
+                printf("ERROR: unknown schedule %s (use cyclic, tile, p2p or part)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-c"))
+            chunk = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-g")){
+            tilerows = strtol(argv[i+1], NULL, 10);
+            gotrows = 1;
+        }
+        if(!strcmp(argv[i],"-k"))
+            steps = strtol(argv[i+1], NULL, 10);
     }
+    /* The tuned tile rows were chosen for the tuned threads. Other threads get theirs chosen again. */
+    if (gotthreads && !gotrows)
+        tilerows = 0;
     if (!flag){
         printf("ERROR: wrong arguments\n");
         exit(22);
@@ -85,6 +149,10 @@ int main (int argc, char *argv[]){
 	    printf("ERROR: wrong number of threads!\n");
         exit(22);
     }
+    if (chunk <= 0 || steps <= 0 || tilerows < 0 || (tilerows && thread_count % tilerows)){
+        printf("ERROR: wrong chunk size, number of steps or tile rows!\n");
+        exit(22);
+    }
 
     /* First, find out my taskid and how many tasks are running */
     MPI_Init_thread(&argc,&argv, MPI_THREAD_MULTIPLE, &provided);
@@ -94,6 +162,19 @@ int main (int argc, char *argv[]){
 
 
     if (taskid == MASTER) {
+        /* Every edge tile of the part schedule calls MPI on its own */
+        if (schedule == PART && provided < MPI_THREAD_MULTIPLE){
+            printf("ERROR: the part schedule needs MPI_THREAD_MULTIPLE\n");
+            MPI_Abort(MPI_COMM_WORLD, 22);
+            exit(22);
+        }
+
+        if (tuned){
+            printf("Loaded tuned configuration from %s.\n", TUNEFILE);
+            if (tuned_ranks != numworkers)
+                printf("WARNING: %s was tuned for %d tasks, not %d.\n", TUNEFILE, tuned_ranks, numworkers);
+        }
+
         if ((isPrime(numworkers))){
             printf("ERROR: the number of workers is prime (%d).\n",numworkers);
             MPI_Abort(MPI_COMM_WORLD, 22);
@@ -118,7 +199,7 @@ int main (int argc, char *argv[]){
 
 
 
-        printf("Grid size: X= %d  Y= %d  Time steps= %d\n",NXPROB,NYPROB,STEPS);
+        printf("Grid size: X= %d  Y= %d  Time steps= %d\n",NXPROB,NYPROB,steps);
 #if 0
         for (ix=0; ix<NXPROB; ix++){
             for (j=0; j<NYPROB; j++)
@@ -223,12 +304,44 @@ int main (int argc, char *argv[]){
     malloc2darr(&local[0], rows+2, columns+2);
     malloc2darr(&local[1], rows+2, columns+2);
 
-    /* Initialize with 0's */
-    for (iz=0; iz<2; iz++){
-        //#pragma omp parallel for collapse(2) schedule(static,1) //TODO auto to ekana logo tou First touch Policy.. alla kai pali den meiw8hke o xronos.
-        for (ix=0; ix<rows+2; ix++) 
-            for (iy=0; iy<columns+2; iy++) 
-                local[iz][ix][iy] = 0.0;
+    /* Find the dimentions of the thread tile grid, the same way as the block grid */
+    for (x=sqrt(thread_count) + 1; x>=1; x--){
+        if (thread_count % x == 0){
+            tx = x;
+            ty = thread_count/x;
+            break;
+        }
+    }
+    if (columns > rows && ty < tx){
+        int a = tx;
+        tx = ty;
+        ty = a;
+    }
+    if (tilerows){
+        tx = tilerows;
+        ty = thread_count/tilerows;
+    }
+    if (taskid == MASTER && schedule != CYCLIC)
+        printf("Each block will part into a %d x %d tile grid.\n",tx,ty);
+
+    /* Initialize with 0's. In tile mode every thread touches its own tile first (First touch Policy),
+     * so the pages of the tile stay on the memory of the core that updates it. */
+    #pragma omp parallel num_threads(thread_count) private(ix,iy,iz) if(schedule != CYCLIC)
+    {
+        struct Tile tile = {1, rows, 1, columns};
+        if (schedule != CYCLIC)
+            findTile(omp_get_thread_num(), tx, ty, rows, columns, &tile);
+
+        /* Tiles on the edge of the block also clear the halo next to them */
+        if (tile.x0 == 1) tile.x0 = 0;
+        if (tile.x1 == rows) tile.x1 = rows+1;
+        if (tile.y0 == 1) tile.y0 = 0;
+        if (tile.y1 == columns) tile.y1 = columns+1;
+
+        for (iz=0; iz<2; iz++)
+            for (ix=tile.x0; ix<=tile.x1; ix++) 
+                for (iy=tile.y0; iy<=tile.y1; iy++) 
+                    local[iz][ix][iy] = 0.0;
     }
 
     /* Preparing the datatypes for Parallel I/o */
@@ -298,15 +411,186 @@ int main (int argc, char *argv[]){
     MPI_Startall(16,req);
     MPI_Waitall(16,req,MPI_STATUS_IGNORE);
 
+    /* Edges of the part schedule, in the order of req: receives from left, right, down, up,
+     * then sends to right, left, up, down. Columns are cut into tx parts and rows into ty. */
+    struct Edge edges[2][8];
+    MPI_Datatype colcell;
+    MPI_Type_create_resized(MPI_FLOAT, 0, (columns+2)*sizeof(float), &colcell);
+    MPI_Type_commit(&colcell);
+    if (schedule == PART){
+        for (iz=0 ; iz < 2 ; iz++){
+            edgeInit(&edges[iz][0], &(local[iz][1][0]), colcell, columns+2, rows, tx, left, 0, comm_cart);
+            edgeInit(&edges[iz][1], &(local[iz][1][columns+1]), colcell, columns+2, rows, tx, right, 0, comm_cart);
+            edgeInit(&edges[iz][2], &(local[iz][rows+1][1]), MPI_FLOAT, 1, columns, ty, down, 0, comm_cart);
+            edgeInit(&edges[iz][3], &(local[iz][0][1]), MPI_FLOAT, 1, columns, ty, up, 0, comm_cart);
+
+            edgeInit(&edges[iz][4], &(local[iz][1][columns]), colcell, columns+2, rows, tx, right, 1, comm_cart);
+            edgeInit(&edges[iz][5], &(local[iz][1][1]), colcell, columns+2, rows, tx, left, 1, comm_cart);
+            edgeInit(&edges[iz][6], &(local[iz][1][1]), MPI_FLOAT, 1, columns, ty, up, 1, comm_cart);
+            edgeInit(&edges[iz][7], &(local[iz][rows][1]), MPI_FLOAT, 1, columns, ty, down, 1, comm_cart);
+        }
+    }
+
     iz = 0;
 
+    /* Step counters for the p2p schedule. done[t] is the last step that tile t has completed,
+     * halo_ready is the last step whose halos have arrived and same[it] counts the tiles that
+     * didn't change at step it. */
+    atomic_int *done = NULL, *same = NULL, halo_ready = 0;
+    if (schedule == P2P || schedule == PART){
+        done = (atomic_int*)malloc(thread_count*sizeof(atomic_int));
+        same = (atomic_int*)malloc((steps+1)*sizeof(atomic_int));
+        for (i=0; i<thread_count; i++)
+            atomic_init(&done[i], 0);
+        for (i=0; i<=steps; i++)
+            atomic_init(&same[i], 0);
+    }
+
     /* Start thread_count threads */
      #pragma omp parallel num_threads(thread_count)
      {
         //int thread_rank = omp_get_thread_num();
         int it;
         int newiz;
-        for (it = 1; it <= STEPS; it++){
+        struct Tile tile;
+        if (schedule != CYCLIC)
+            findTile(omp_get_thread_num(), tx, ty, rows, columns, &tile);
+
+        if (schedule == P2P || schedule == PART){
+            //----------------------------------------------------------------------------------------------------------------------------------------------
+            // No barriers here. A tile reads its own cells and the first row/column of the tiles next to it, which they
+            // wrote during the previous step, so before step it it only waits until its neighbor tiles have done step it-1.
+            // Thread 0 also does the communication: it sends when the tiles on the edge of the block have done step it-1 and
+            // publishes halo_ready = it when the halos of step it have arrived. Only the edge of a tile waits for that.
+            //
+            // In the part schedule thread 0 only recycles the edge requests: halo_ready = it means that the exchange of
+            // step it-1 is complete and the one of step it+1 is started. Every edge tile then waits for its own parts of
+            // the halo, and marks its parts of the next edge ready as soon as it has computed them.
+            //----------------------------------------------------------------------------------------------------------------------------------------------
+            int tid = omp_get_thread_num(),
+                tr = tid / ty, tc = tid % ty,
+                edge = (tr == 0 || tr == tx-1 || tc == 0 || tc == ty-1),
+                t, part, local_identical, global_identical;
+
+            for (it = 1; it <= steps; it++){
+                newiz = (it % 2)*(-1)+1;
+
+                if (tr > 0) waitFor(&done[tid-ty], it-1);
+                if (tr < tx-1) waitFor(&done[tid+ty], it-1);
+                if (tc > 0) waitFor(&done[tid-1], it-1);
+                if (tc < ty-1) waitFor(&done[tid+1], it-1);
+
+                if (tid == 0 && schedule == PART){
+                    /* Every edge tile has read its halo of step it-1 and readied its part of this step's edge */
+                    for (t=0; t<thread_count; t++)
+                        if (t/ty == 0 || t/ty == tx-1 || t%ty == 0 || t%ty == ty-1)
+                            waitFor(&done[t], it-1);
+
+                    if (it > 1)
+                        for (t=0; t<8; t++)
+                            edgeWait(&edges[1-newiz][t]);
+                    else{
+                        /* nobody computed the edge of the first step, so it is ready right away */
+                        for (t=0; t<8; t++)
+                            edgeStart(&edges[newiz][t]);
+                        for (t=4; t<8; t++)
+                            for (part=0; part<edges[newiz][t].parts; part++)
+                                edgeReady(&edges[newiz][t], part);
+                    }
+                    if (it < steps)
+                        for (t=0; t<8; t++)
+                            edgeStart(&edges[1-newiz][t]);
+                    atomic_store_explicit(&halo_ready, it, memory_order_release);
+                }
+                else if (tid == 0){
+                    /* The edge of the block from step it-1 is going to be sent */
+                    for (t=0; t<thread_count; t++)
+                        if (t/ty == 0 || t/ty == tx-1 || t%ty == 0 || t%ty == ty-1)
+                            waitFor(&done[t], it-1);
+
+                    /// *** RECEIVING PROCEDURES *** ///
+                    MPI_Irecv(&(local[newiz][1][0]), 1, column, left, 0, comm_cart, &RRequestL);
+                    MPI_Irecv(&(local[newiz][1][columns+1]), 1, column, right, 0, comm_cart, &RRequestR);
+                    MPI_Irecv(&(local[newiz][rows+1][1]), columns, MPI_FLOAT, down, 0, comm_cart, &RRequestD);
+                    MPI_Irecv(&(local[newiz][0][1]), columns, MPI_FLOAT, up,0, comm_cart, &RRequestU);
+
+                    /// *** SENDING PROCEDURES *** ///
+                    MPI_Isend(&(local[newiz][1][columns]), 1, column, right, 0, comm_cart, &SRequestR);  //sends column to RIGHT neighbor
+                    MPI_Isend(&(local[newiz][1][1]), 1, column, left , 0, comm_cart, &SRequestL);	//sends column to left neighbor
+                    MPI_Isend(&(local[newiz][1][1]), columns, MPI_FLOAT, up, 0, comm_cart, &SRequestU);  //sends to UP neighbor
+                    MPI_Isend(&(local[newiz][rows][1]), columns, MPI_FLOAT, down ,0, comm_cart, &SRequestD); //sends to DOWN neighbor
+                }
+
+                /// *** CALCULATION OF INTERNAL DATA *** ///
+                updateInternalTile(&tile, rows, columns, &local[newiz][0][0], &local[1-newiz][0][0]);
+
+                if (tid == 0){
+                    /* Convergence check of the previous step, once every tile has counted itself */
+                    if (it > 1){
+                        for (t=0; t<thread_count; t++)
+                            waitFor(&done[t], it-1);
+                        local_identical = (atomic_load_explicit(&same[it-1], memory_order_relaxed) == thread_count);
+                        MPI_Allreduce(&local_identical, &global_identical, 1, MPI_INT, MPI_LAND,MPI_COMM_WORLD);
+                    }
+                }
+
+                if (tid == 0 && schedule == P2P){
+                    if (right != MPI_PROC_NULL) MPI_Wait(&RRequestR , MPI_STATUS_IGNORE );
+                    if (left != MPI_PROC_NULL) MPI_Wait(&RRequestL , MPI_STATUS_IGNORE );
+                    if (up !=  MPI_PROC_NULL) MPI_Wait(&RRequestU , MPI_STATUS_IGNORE );
+                    if (down !=  MPI_PROC_NULL) MPI_Wait(&RRequestD , MPI_STATUS_IGNORE );
+
+                    if (right != MPI_PROC_NULL) MPI_Wait(&SRequestR , MPI_STATUS_IGNORE );
+                    if (left != MPI_PROC_NULL) MPI_Wait(&SRequestL , MPI_STATUS_IGNORE );
+                    if (up !=  MPI_PROC_NULL) MPI_Wait(&SRequestU , MPI_STATUS_IGNORE );
+                    if (down !=  MPI_PROC_NULL) MPI_Wait(&SRequestD , MPI_STATUS_IGNORE );
+
+                    atomic_store_explicit(&halo_ready, it, memory_order_release);
+                }
+
+                /// *** CALCULATION OF EXTERNAL DATA *** ///
+                if (edge && schedule == PART){
+                    waitFor(&halo_ready, it);
+                    if (tc == 0) edgeArrived(&edges[newiz][0], tr);
+                    if (tc == ty-1) edgeArrived(&edges[newiz][1], tr);
+                    if (tr == tx-1) edgeArrived(&edges[newiz][2], tc);
+                    if (tr == 0) edgeArrived(&edges[newiz][3], tc);
+
+                    updateExternalTile(&tile, rows, columns, right,left,up,down, &local[newiz][0][0], &local[1-newiz][0][0]);
+
+                    /* the edge of the tile is final, so its part of the next exchange can go */
+                    if (it < steps){
+                        if (tc == ty-1) edgeReady(&edges[1-newiz][4], tr);
+                        if (tc == 0) edgeReady(&edges[1-newiz][5], tr);
+                        if (tr == 0) edgeReady(&edges[1-newiz][6], tc);
+                        if (tr == tx-1) edgeReady(&edges[1-newiz][7], tc);
+                    }
+                }
+                else if (edge){
+                    waitFor(&halo_ready, it);
+                    updateExternalTile(&tile, rows, columns, right,left,up,down, &local[newiz][0][0], &local[1-newiz][0][0]);
+                }
+
+                if (isIdenticalTile(&tile, columns, &local[newiz][0][0], &local[1-newiz][0][0]))
+                    atomic_fetch_add_explicit(&same[it], 1, memory_order_relaxed);
+                atomic_store_explicit(&done[tid], it, memory_order_release);
+            }
+
+            /* Convergence check of the last step */
+            if (tid == 0){
+                for (t=0; t<thread_count; t++)
+                    waitFor(&done[t], steps);
+                local_identical = (atomic_load_explicit(&same[steps], memory_order_relaxed) == thread_count);
+                MPI_Allreduce(&local_identical, &global_identical, 1, MPI_INT, MPI_LAND,MPI_COMM_WORLD);
+
+                /* the exchange of the last step is the only one still open */
+                if (schedule == PART)
+                    for (t=0; t<8; t++)
+                        edgeWait(&edges[(steps % 2)*(-1)+1][t]);
+            }
+        }
+        else
+        for (it = 1; it <= steps; it++){
             newiz = (it % 2)*(-1)+1;
 
             #pragma omp single
@@ -326,7 +610,10 @@ int main (int argc, char *argv[]){
             
 
             /// *** CALCULATION OF INTERNAL DATA *** ///
-            updateInternal(2, rows-1, columns,&local[newiz][0][0], &local[1-newiz][0][0]); // 2 and xdim-3 because we want to calculate only internal nodes of the block.
+            if (schedule == TILE)
+                updateInternalTile(&tile, rows, columns, &local[newiz][0][0], &local[1-newiz][0][0]);
+            else
+                updateInternal(2, rows-1, columns,&local[newiz][0][0], &local[1-newiz][0][0]); // 2 and xdim-3 because we want to calculate only internal nodes of the block.
             //line 0 contains neighbor's values and line 1 is the extrnal line of the block, so we don't want them. The same for the one before last and the last line.
             #pragma omp single
 	        {
@@ -337,7 +624,13 @@ int main (int argc, char *argv[]){
 	        }
 
             /// *** CALCULATION OF EXTERNAL DATA *** ///
-            updateExternal(1,rows, columns,right,left,up,down, &local[newiz][0][0], &local[1-newiz][0][0]);
+            if (schedule == TILE){
+                updateExternalTile(&tile, rows, columns, right,left,up,down, &local[newiz][0][0], &local[1-newiz][0][0]);
+                /* there is no omp for to wait for the other tiles */
+                #pragma omp barrier
+            }
+            else
+                updateExternal(1,rows, columns,right,left,up,down, &local[newiz][0][0], &local[1-newiz][0][0]);
             #pragma omp single
             {
 
@@ -398,7 +691,7 @@ int main (int argc, char *argv[]){
     finish = MPI_Wtime();
 
     /* Gather it all back */
-    iz = STEPS %2;
+    iz = steps %2;
 
     /* Each worker writes to its portion of the file */
     MPI_File_open(MPI_COMM_WORLD, outputfile, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
@@ -415,6 +708,8 @@ int main (int argc, char *argv[]){
     /* Free malloc'd memory */
     free2darr(&local[0]);
     free2darr(&local[1]);
+    free(done);
+    free(same);
 
     MPI_Type_free(&sendsubarrtype);
     MPI_Type_free(&recvsubarrtype);
@@ -422,6 +717,11 @@ int main (int argc, char *argv[]){
 
     for(i=0; i<16 ; i++)
         MPI_Request_free(&(req[i]));
+    if (schedule == PART)
+        for (iz=0; iz<2; iz++)
+            for (i=0; i<8; i++)
+                edgeFree(&edges[iz][i]);
+    MPI_Type_free(&colcell);
     
     MPI_Finalize();
     return 0;
@@ -436,7 +736,7 @@ void updateInternal(int start, int end, int ny, float *u1, float *u2)
 {
 
    int ix, iy;
-   #pragma omp for collapse(2) schedule(static,1)
+   #pragma omp for collapse(2) schedule(static,chunk)
    for (ix = start; ix <= end; ix++){ 
       for (iy = 2; iy <= ny-1; iy++){
          *(u2+ix*(ny+2)+iy) = *(u1+ix*(ny+2)+iy)  + 
@@ -484,7 +784,7 @@ void updateExternal(int start, int end, int ny,int right, int left,int up,int do
         endny = ny-3;
 
     is = iy;
-    #pragma omp for schedule(static,1)
+    #pragma omp for schedule(static,chunk)
     for (iy=is; iy <= endny; iy++) {
          *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + 
                           parms.cx * (*(u1+(ix+1)*ny+iy) +
@@ -512,7 +812,7 @@ void updateExternal(int start, int end, int ny,int right, int left,int up,int do
         endny = ny-3;
 
     is=iy;
-    #pragma omp for schedule(static,1)
+    #pragma omp for schedule(static,chunk)
     for (iy=is; iy <= endny; iy++) 
          *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + 
                           parms.cx * (*(u1+(ix+1)*ny+iy) +
@@ -543,7 +843,7 @@ void updateExternal(int start, int end, int ny,int right, int left,int up,int do
 
     is = ix;
 
-    #pragma omp for schedule(static,1)
+    #pragma omp for schedule(static,chunk)
     for (ix=is; ix<endloop; ix++)
         *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + 
                           parms.cx * (*(u1+(ix+1)*ny+iy) +
@@ -570,7 +870,7 @@ void updateExternal(int start, int end, int ny,int right, int left,int up,int do
        endloop = end -3; // the down right corner is calculated from row calculation, so we don't need to calculate again
 
     is = ix;
-    #pragma omp for schedule(static,1)
+    #pragma omp for schedule(static,chunk)
     for (ix=is; ix<endloop; ix++)
        *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + parms.cx * (*(u1+(ix+1)*ny+iy) +
                           *(u1+(ix-1)*ny+iy) - 
@@ -581,6 +881,215 @@ void updateExternal(int start, int end, int ny,int right, int left,int up,int do
 }
 
 
+/**************************************************************************
+ *  subroutine findTile
+/// gives the rows and columns of the block that thread tid owns, when the
+/// block is split into a tx x ty grid of tiles
+ ****************************************************************************/
+void findTile(int tid, int tx, int ty, int rows, int columns, struct Tile *tile)
+{
+    int tr = tid / ty,
+        tc = tid % ty;
+
+    tile->x0 = 1 + (tr*rows)/tx;
+    tile->x1 = ((tr+1)*rows)/tx;
+    tile->y0 = 1 + (tc*columns)/ty;
+    tile->y1 = ((tc+1)*columns)/ty;
+}
+
+/**************************************************************************
+ *  subroutine updateRegion
+/// updates the rectangle [x0,x1] x [y0,y1] (inclusive). ny = number of block
+/// columns without the two which keep LEFT AND RIGHT neighbors' values
+ ****************************************************************************/
+void updateRegion(int x0, int x1, int y0, int y1, int ny, float *u1, float *u2)
+{
+   int ix, iy;
+   for (ix = x0; ix <= x1; ix++){ 
+      for (iy = y0; iy <= y1; iy++){
+         *(u2+ix*(ny+2)+iy) = *(u1+ix*(ny+2)+iy)  + 
+                          parms.cx * (*(u1+(ix+1)*(ny+2)+iy) +
+                          *(u1+(ix-1)*(ny+2)+iy) - 
+                          2.0 * *(u1+ix*(ny+2)+iy)) +
+                          parms.cy * (*(u1+ix*(ny+2)+iy+1) +
+                         *(u1+ix*(ny+2)+iy-1) - 
+                          2.0 * *(u1+ix*(ny+2)+iy));
+       }
+    }
+}
+
+/**************************************************************************
+ *  subroutine updateInternalTile
+/// updates the part of the tile that doesn't need the neighbors' values,
+/// that is rows 2..rows-1 and columns 2..columns-1 of the block
+ ****************************************************************************/
+void updateInternalTile(struct Tile *tile, int rows, int columns, float *u1, float *u2)
+{
+    updateRegion(tile->x0 > 2 ? tile->x0 : 2, tile->x1 < rows-1 ? tile->x1 : rows-1,
+                 tile->y0 > 2 ? tile->y0 : 2, tile->y1 < columns-1 ? tile->y1 : columns-1,
+                 columns, u1, u2);
+}
+
+/**************************************************************************
+ *  subroutine updateExternalTile
+/// updates the part of the tile that lies on the first/last row and column
+/// of the block. Rows/columns without a neighbor are the boundary of the
+/// whole grid, so they are not calculated.
+ ****************************************************************************/
+void updateExternalTile(struct Tile *tile, int rows, int columns, int right, int left, int up, int down, float *u1, float *u2)
+{
+    int y0 = tile->y0, y1 = tile->y1,
+        x0 = tile->x0 > 2 ? tile->x0 : 2,
+        x1 = tile->x1 < rows-1 ? tile->x1 : rows-1;
+
+    /* the corners belong to the rows, so the rows take the first/last column when there is a neighbor there */
+    if (left == MPI_PROC_NULL && y0 == 1) y0 = 2;
+    if (right == MPI_PROC_NULL && y1 == columns) y1 = columns-1;
+
+    if (up != MPI_PROC_NULL && tile->x0 == 1)
+        updateRegion(1, 1, y0, y1, columns, u1, u2);
+    if (down != MPI_PROC_NULL && tile->x1 == rows)
+        updateRegion(rows, rows, y0, y1, columns, u1, u2);
+    if (left != MPI_PROC_NULL && tile->y0 == 1)
+        updateRegion(x0, x1, 1, 1, columns, u1, u2);
+    if (right != MPI_PROC_NULL && tile->y1 == columns)
+        updateRegion(x0, x1, columns, columns, columns, u1, u2);
+}
+
+/**************************************************************************
+ *  subroutine waitFor
+/// spins until counter reaches step. The acquire load pairs with the release
+/// store of the thread that owns the counter, so everything that thread wrote
+/// before the store is visible afterwards.
+ ****************************************************************************/
+void waitFor(atomic_int *counter, int step)
+{
+    while (atomic_load_explicit(counter, memory_order_acquire) < step)
+        sched_yield();
+}
+
+/**************************************************************************
+ *  subroutine edgeInit
+/// prepares an edge of cells cells, stride floats apart, starting at buf.
+/// It is exchanged with peer in parts parts. Nothing happens on the edges
+/// without a neighbor.
+ ****************************************************************************/
+void edgeInit(struct Edge *e, float *buf, MPI_Datatype cell, int stride, int cells, int parts, int peer, int send, MPI_Comm comm)
+{
+    int i;
+
+    e->buf = buf;
+    e->cell = cell;
+    e->stride = stride;
+    e->cells = cells;
+    e->parts = parts;
+    e->peer = peer;
+    e->send = send;
+    e->comm = comm;
+    e->req = MPI_REQUEST_NULL;
+    e->part = (MPI_Request*)malloc(parts*sizeof(MPI_Request));
+    for (i=0; i<parts; i++)
+        e->part[i] = MPI_REQUEST_NULL;
+
+    if (peer == MPI_PROC_NULL)
+        return;
+#if MPI_VERSION >= 4
+    if (send)
+        MPI_Psend_init(buf, cells, 1, cell, peer, PTAG, comm, MPI_INFO_NULL, &e->req);
+    else
+        MPI_Precv_init(buf, cells, 1, cell, peer, PTAG, comm, MPI_INFO_NULL, &e->req);
+#endif
+}
+
+/**************************************************************************
+ *  subroutine edgeStart
+/// starts the exchange of the edge for one step
+ ****************************************************************************/
+void edgeStart(struct Edge *e)
+{
+    if (e->peer == MPI_PROC_NULL)
+        return;
+#if MPI_VERSION >= 4
+    MPI_Start(&e->req);
+#else
+    int i, first;
+    if (!e->send)
+        for (i=0; i<e->parts; i++){
+            first = (i*e->cells)/e->parts;
+            MPI_Irecv(e->buf + first*e->stride, ((i+1)*e->cells)/e->parts - first, e->cell,
+                      e->peer, PTAG+i, e->comm, &e->part[i]);
+        }
+#endif
+}
+
+/**************************************************************************
+ *  subroutine edgeReady
+/// sends part i of a started edge
+ ****************************************************************************/
+void edgeReady(struct Edge *e, int i)
+{
+    int first = (i*e->cells)/e->parts,
+        last = ((i+1)*e->cells)/e->parts - 1;
+
+    if (e->peer == MPI_PROC_NULL)
+        return;
+#if MPI_VERSION >= 4
+    MPI_Pready_range(first, last, e->req);
+#else
+    MPI_Isend(e->buf + first*e->stride, last - first + 1, e->cell,
+              e->peer, PTAG+i, e->comm, &e->part[i]);
+#endif
+}
+
+/**************************************************************************
+ *  subroutine edgeArrived
+/// spins until part i of a started edge has arrived
+ ****************************************************************************/
+void edgeArrived(struct Edge *e, int i)
+{
+    int flag = 0;
+
+    if (e->peer == MPI_PROC_NULL)
+        return;
+#if MPI_VERSION >= 4
+    int p;
+    for (p = (i*e->cells)/e->parts; p < ((i+1)*e->cells)/e->parts; p++)
+        for (flag = 0; !flag; sched_yield())
+            MPI_Parrived(e->req, p, &flag);
+#else
+    for (; !flag; sched_yield())
+        MPI_Test(&e->part[i], &flag, MPI_STATUS_IGNORE);
+#endif
+}
+
+/**************************************************************************
+ *  subroutine edgeWait
+/// completes the exchange of the edge for one step
+ ****************************************************************************/
+void edgeWait(struct Edge *e)
+{
+    if (e->peer == MPI_PROC_NULL)
+        return;
+#if MPI_VERSION >= 4
+    MPI_Wait(&e->req, MPI_STATUS_IGNORE);
+#else
+    MPI_Waitall(e->parts, e->part, MPI_STATUSES_IGNORE);
+#endif
+}
+
+/**************************************************************************
+ *  subroutine edgeFree
+ ****************************************************************************/
+void edgeFree(struct Edge *e)
+{
+#if MPI_VERSION >= 4
+    if (e->peer != MPI_PROC_NULL)
+        MPI_Request_free(&e->req);
+#endif
+    free(e->part);
+}
+
+
 /*****************************************************************************
  *  subroutine inidat
  *****************************************************************************/
@@ -681,6 +1190,56 @@ for (ix = 0; ix <= nx-1; ix++)
 }
 
 
+/* Returns the schedule with the given name or -1 if there is no such schedule */
+int scheduleOf(const char *name){
+    if (!strcmp(name,"cyclic"))
+        return CYCLIC;
+    if (!strcmp(name,"tile"))
+        return TILE;
+    if (!strcmp(name,"p2p"))
+        return P2P;
+    if (!strcmp(name,"part"))
+        return PART;
+    return -1;
+}
+
+/* Reads the configuration that autotune.sh found best. Every line of the file is "key value".
+ * Returns 1 if the file exists and 0 otherwise */
+int loadTune(const char *filename, int *ranks, int *thread_count, int *schedule, int *tilerows){
+    FILE *fp;
+    char key[32], value[32];
+
+    fp = fopen(filename, "r");
+    if(!fp)
+        return 0;
+
+    while (fscanf(fp, "%31s %31s", key, value) == 2){
+        if (!strcmp(key,"ranks"))
+            *ranks = strtol(value, NULL, 10);
+        else if (!strcmp(key,"threads"))
+            *thread_count = strtol(value, NULL, 10);
+        else if (!strcmp(key,"schedule") && scheduleOf(value) >= 0)
+            *schedule = scheduleOf(value);
+        else if (!strcmp(key,"chunk"))
+            chunk = strtol(value, NULL, 10);
+        else if (!strcmp(key,"tilerows"))
+            *tilerows = strtol(value, NULL, 10);
+    }
+    fclose(fp);
+
+    return 1;
+}
+
+//returns 1 when the cells of the tile are identical in both arrays and 0 when they are not
+int isIdenticalTile(struct Tile *tile, int columns, float *array1, float *array2){
+    int i,j;
+    for (i=tile->x0; i<=tile->x1; i++)
+        for (j=tile->y0; j<=tile->y1; j++)
+            if (fabs( *(array1+i*(columns+2)+j) - *(array2+i*(columns+2)+j)) > 0.01)
+                return 0;
+    return 1;
+}
+
 //returns 1 when arrays are identical and 0 when the are not identical
 int isIdentical(float *array1,float *array2, int rows,int columns){
     int i,j;
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Runs mpi_omp_heat2Dn with the number of tasks found by autotune.sh.
+# The rest of the tuned configuration is loaded by the program itself.
+# usage: ./run.sh [-i input] [-o output]
+
+TUNEFILE=heat2D.tune
+
+if [ ! -f $TUNEFILE ]; then
+    echo "ERROR: $TUNEFILE not found, run autotune.sh first"
+    exit 1
+fi
+mpirun -n $(awk '$1 == "ranks" { print $2 }' $TUNEFILE) ./mpi_omp_heat2Dn "$@"
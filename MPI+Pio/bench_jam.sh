@@ -0,0 +1,24 @@
+#!/bin/sh
+# Compares the interior calculated one row at a time (-J 1) with 2 and 4
+# rows per sweep (-J 2, -J 4), with the overlapped pipeline, which is the
+# one that calculates the interior on its own. The solver and grid_generator
+# are built for the grid size in bench_* files. Prints the slowest process
+# time of every run.
+# usage: ./bench_jam.sh [tasks] [grid rows] [grid columns] [repetitions]
+
+TASKS=${1:-4}
+NX=${2:-512}
+NY=${3:-4096}
+REPS=${4:-5}
+
+mpicc -DNXPROB=$NX -DNYPROB=$NY mpi_heat2Dn.c -o bench_heat2Dn -lm -O3 || exit 1
+mpicc -DNXPROB=$NX -DNYPROB=$NY ../grid_generator.c -o bench_generator || exit 1
+./bench_generator > /dev/null && mv initial.dat bench_input.dat
+
+for jam in 1 2 4; do
+    for rep in $(seq $REPS); do
+        mpirun -n $TASKS ./bench_heat2Dn -p overlap -J $jam -i bench_input.dat -o bench.dat |
+            awk -v j=$jam '/Elapsed time/ { if ($4+0 > max) max = $4+0 } END { printf "-J %d %e secs\n", j, max }'
+    done
+done
+rm -f bench.dat bench_input.dat bench_heat2Dn bench_generator
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Compares the row-major layout of the blocks (-L rows) with the tiled one
+# (-L tiled), both with the plain pipeline, on a large grid. The solver and
+# grid_generator are built for that grid size in bench_* files. Prints the
+# slowest process time of every run.
+# usage: ./bench_layout.sh [tasks] [grid rows] [grid columns] [repetitions]
+
+TASKS=${1:-4}
+NX=${2:-512}
+NY=${3:-32768}
+REPS=${4:-5}
+
+mpicc -DNXPROB=$NX -DNYPROB=$NY mpi_heat2Dn.c -o bench_heat2Dn -lm -O3 || exit 1
+mpicc -DNXPROB=$NX -DNYPROB=$NY ../grid_generator.c -o bench_generator || exit 1
+./bench_generator > /dev/null && mv initial.dat bench_input.dat
+
+for layout in rows tiled; do
+    for rep in $(seq $REPS); do
+        mpirun -n $TASKS ./bench_heat2Dn -p plain -L $layout -i bench_input.dat -o bench.dat |
+            awk -v l=$layout '/Elapsed time/ { if ($4+0 > max) max = $4+0 } END { printf "%-6s %e secs\n", l, max }'
+    done
+done
+rm -f bench.dat bench_input.dat bench_heat2Dn bench_generator
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Compares normal (-N off) and non-temporal (-N on) stores in the sweeps over
+# the grid, with the overlapped and the plain pipeline. The solver and
+# grid_generator are built for the grid size in bench_* files; pick one whose
+# grids are larger than the last level cache (the solver prints both sizes).
+# Prints the slowest process time of every run.
+# usage: ./bench_stream.sh [tasks] [grid rows] [grid columns] [repetitions]
+
+TASKS=${1:-4}
+NX=${2:-1024}
+NY=${3:-32768}
+REPS=${4:-5}
+
+mpicc -DNXPROB=$NX -DNYPROB=$NY mpi_heat2Dn.c -o bench_heat2Dn -lm -O3 || exit 1
+mpicc -DNXPROB=$NX -DNYPROB=$NY ../grid_generator.c -o bench_generator || exit 1
+./bench_generator > /dev/null && mv initial.dat bench_input.dat
+
+for pipeline in overlap plain; do
+    for stores in off on; do
+        for rep in $(seq $REPS); do
+            mpirun -n $TASKS ./bench_heat2Dn -p $pipeline -N $stores -i bench_input.dat -o bench.dat |
+                awk -v p=$pipeline -v s=$stores '/Elapsed time/ { if ($4+0 > max) max = $4+0 }
+                                                 END { printf "%-8s %-4s %e secs\n", p, s, max }'
+        done
+    done
+done
+rm -f bench.dat bench_input.dat bench_heat2Dn bench_generator
@@ -27,24 +27,534 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+#ifndef NXPROB                         /* may be given with -D, see bench_layout.sh */
 #define NXPROB      80                  /* x dimension of problem grid */
+#endif
+#ifndef NYPROB
 #define NYPROB      64                 /* y dimension of problem grid */
+#endif
+#ifndef STEPS
 #define STEPS       100                /* number of time steps */
+#endif
 #define BEGIN       2                  /* message tag */
 #define LTAG        2                  /* message tag */
 #define RTAG        3                  /* message tag */
 #define NONE        0                  /* indicates no neighbor */
 #define DONE        4                  /* message tag */
 #define MASTER      0                  /* taskid of first process */
+#define OVERLAP     0                  /* send old edges, compute interior, then edges */
+#define FIRST       1                  /* compute and send new edges first, then interior */
+#define PLAIN       2                  /* exchange, then update the whole block in one pass */
+#define AUTO        3                  /* OVERLAP or PLAIN, whichever the startup measurement predicts faster */
+#define INPLACE     4                  /* like PLAIN, but with one grid updated in place */
+#define TRIALS      10                 /* repetitions of every measurement of AUTO */
+#define UP          0                  /* sides of the block */
+#define DOWN        1
+#define LEFT        2
+#define RIGHT       3
+#define P2P_BACKEND        0           /* halo exchange backends, see exchangeInit */
+#define PERSISTENT_BACKEND 1
+#define NEIGHBOR_BACKEND   2
+#define RMA_BACKEND        3
+#define SHM_BACKEND        4
+#define AUTO_BACKEND       5           /* time all of them and keep the fastest */
+#define FP32        0                  /* precision of the halo messages */
+#define FP16        1                  /* IEEE half, saturated to its largest finite value */
+#define BF16        2                  /* the upper 16 bits of a float */
+#define DELTA       3                  /* the change since the last message, with -m mantissa bits */
+#define ALIGN       64                 /* bytes of a cache line, and of the widest SIMD register */
+#define HUGEPAGE    (2*1024*1024)      /* bytes of a transparent huge page */
+#define STREAM_OFF  0                  /* stores of the sweeps over the grid (-N) */
+#define STREAM_ON   1                  /* non-temporal, bypassing the cache */
+#define STREAM_AUTO 2                  /* on if the grids of the node don't fit in the last level cache */
+#define JAMMAX      4                  /* most rows updateInternal calculates in one sweep (-J) */
+#define ROWMAJOR    0                  /* layout of the block, see struct Tiled */
+#define TILED       1
+#define TILE        16                 /* points on a side of a tile: a tile row is a cache line */
+#define LINES(bytes) (((size_t)(bytes) + ALIGN-1) / ALIGN * ALIGN)     /* bytes rounded up to whole cache lines */
 
 struct Parms { 
   float cx;
   float cy;
 } parms = {0.1, 0.1};
 
-void inidat(), prtdat(), updateExternal(), updateInternal(),  myprint(), DUMMYDUMDUM();
-int malloc2darr(),free2darr(),isPrime(),checkSize();
+/* Contiguous buffers of the halo points, one for each side of the block. up/down are indexed like
+ * the columns of the block (1..columns) and left/right like its rows (1..rows). */
+struct Halo {
+  float *up, *down, *left, *right;
+};
+
+/* Halo exchange of one step, with one of the backends of exchangeInit. start(ex, iz) begins sending the
+ * edges of domain iz and receiving the halos; finish(ex) returns when the halos have arrived and the edges
+ * that were sent may be overwritten. Sides are UP, DOWN, LEFT, RIGHT; the neighbor on side s sees this
+ * block on side s^1. */
+struct Exchange {
+  const char *name;
+  void (*start)(struct Exchange *ex, int iz);
+  void (*finish)(struct Exchange *ex);
+  void (*free)(struct Exchange *ex);
+  int nb[4];                    /* neighbor tasks */
+  int count[4];                 /* floats exchanged with each neighbor */
+  float *send[2][4];            /* edge of each domain that goes to each neighbor */
+  float *recv[4];               /* halo buffer each neighbor fills (its first point) */
+  struct Halo *halo;
+  MPI_Comm comm;                /* the cartesian communicator */
+  MPI_Request req[16];          /* 8 per step; the persistent backend keeps 8 per domain */
+  int domain;                   /* domain of the step in progress (persistent) */
+  MPI_Aint sdispl[2][4], rdispl[4];     /* absolute addresses for the neighborhood collective */
+  MPI_Datatype type[4];          /* element of every message, MPI_FLOAT unless the halos are encoded */
+  int size;                     /* bytes of an element */
+  MPI_Win win;                  /* RMA and shared memory backends */
+  MPI_Aint offset[4];           /* window offset of each halo buffer (RMA) */
+  float *peer[4];               /* halo buffer of each neighbor (shared memory) */
+  float *saved;                 /* the halo buffers of main, put back by the shared memory backend */
+};
+
+int exchangeInit(struct Exchange *ex, int backend, const int nb[4], int rows, int columns, MPI_Datatype elem,
+                 float *send[2][4], struct Halo *halo, MPI_Comm comm);
+
+const char *backendName[AUTO_BACKEND+1] = {"p2p", "persistent", "neighbor", "rma", "shm", "auto"};
+
+/* Reduced precision halos (-q). The edges are encoded to 16 bit codes before the exchange, which moves
+ * the codes between buffers laid out like the real ones, and widened into the halo buffers after it.
+ * The encoder decodes every code too, so it knows the exact error of what the neighbor will get. */
+struct Reduced {
+  int mode;                     /* FP32, FP16, BF16 or DELTA */
+  int bits;                     /* mantissa bits kept by DELTA (0..7) */
+  int count[4];                 /* points of each side */
+  float *edge[2][4];            /* the edges of each domain, in float */
+  float *code[2][4];            /* their codes, 2 bytes per point */
+  struct Halo *halo;            /* where the received halos are widened to */
+  struct Halo stage;            /* where the codes are received, laid out like halo */
+  float *sent[4], *got[4];      /* DELTA: what each neighbor has of our edge, what we have of its edge */
+  double maxerr, sumerr;        /* largest and summed squared error of the points sent */
+  long points, saturated;       /* points sent, and how many of them FP16 couldn't hold */
+};
+
+/* Every buffer of the solver comes from one allocation per task, sized from the decomposition before
+ * any work starts (see arenaSize), so the footprint is known up front and a task that doesn't fit fails
+ * at startup. Nothing is freed on its own; arenaFree releases it all. */
+struct Arena {
+  char *base;                   /* cache line aligned */
+  size_t size, used;            /* bytes */
+};
+
+/* Tiled layout (-L tiled): the rows x columns points of the block, without the halo, in TILE x TILE tiles.
+ * The points of a tile are consecutive, row by row, and the tiles follow each other in Morton order, so
+ * the neighbors of a point are in its own tile or in one stored close to it however wide the block is. The
+ * last tile row and column may be partly used. */
+struct Tiled {
+  int rows, columns;
+  int tr, tc;                   /* tiles down and across */
+  int *order;                   /* tile ti*tc+tj of each storage position */
+  int *offset;                  /* float where tile ti*tc+tj starts */
+};
+
+size_t arenaSize(int rows, int columns, int grids, int layout, int precision);
+int arenaInit(struct Arena *a, size_t size, int huge, int bind);
+void *arenaAlloc(struct Arena *a, size_t bytes);
+void arenaFree(struct Arena *a);
+
+void reducedInit(struct Reduced *q, int mode, int bits, int rows, int columns, float *edge[2][4], struct Halo *halo,
+                 struct Arena *arena);
+void haloStart(struct Exchange *ex, struct Reduced *q, int iz);
+void haloFinish(struct Exchange *ex, struct Reduced *q);
+void tiledInit(struct Tiled *t, int rows, int columns, struct Arena *arena);
+void tiledRow(const struct Tiled *t, float *u, int ix, float *row, int store);
+void tiledPack(const struct Tiled *t, const float *u, float *packup, float *packdown, float *packleft, float *packright);
+
+/* New value of point c, given its neighbors n(up), s(down), w(left) and e(right) */
+static inline float stencil(float c, float n, float s, float w, float e)
+{
+    return c + parms.cx * (s + n - 2.0 * c) + parms.cy * (e + w - 2.0 * c);
+}
+
+/**************************************************************************
+ *  subroutines updateRow, updateColumn
+/// update row ix from column y0 to y1, or column iy from row x0 to x1
+/// (inclusive). ld = floats from a row of the block to the next (see
+/// malloc2darr).
+/// updateRow reads the rows above and below from the given arrays, which
+/// are indexed like the row. updateColumn reads the column on the given
+/// side (-1 left, 1 right) from halo and also writes every new value to
+/// pack[ix], the contiguous buffer the column is sent from.
+ ****************************************************************************/
+static inline void updateRow(int ix, int y0, int y1, int ld, const float *restrict u1, float *restrict u2,
+                             const float *restrict above, const float *restrict below)
+{
+    int iy;
+    const float *restrict row = u1 + ix*ld;
+    for (iy = y0; iy <= y1; iy++)
+        u2[ix*ld+iy] = stencil(row[iy], above[iy], below[iy], row[iy-1], row[iy+1]);
+}
+
+static inline void updateColumn(int iy, int x0, int x1, int ld, const float *restrict u1, float *restrict u2,
+                                const float *restrict halo, const int side, float *restrict pack)
+{
+    int ix;
+    float value;
+    for (ix = x0; ix <= x1; ix++){
+        value = stencil(u1[ix*ld+iy], u1[(ix-1)*ld+iy], u1[(ix+1)*ld+iy],
+                        side < 0 ? halo[ix] : u1[ix*ld+iy-1],
+                        side > 0 ? halo[ix] : u1[ix*ld+iy+1]);
+        u2[ix*ld+iy] = value;
+        pack[ix] = value;
+    }
+}
+
+/**************************************************************************
+ *  subroutine streamRow
+/// updateRow with non-temporal stores: the new row goes to memory without
+/// first reading its old values into the cache, which the sweep would only
+/// overwrite. The stencil is evaluated 4 points at a time in double, step
+/// by step like stencil, so the results are the same. The points before
+/// the first 16 byte boundary of the row and after the last whole vector
+/// are stored normally. Without SSE2 it is updateRow. The caller fences
+/// the stores when the sweep is done.
+ ****************************************************************************/
+#ifdef __SSE2__
+/* stencil of 4 points at a time, in double like stencil */
+static inline __m128 stencil4(__m128 c, __m128 n, __m128 s, __m128 w, __m128 e)
+{
+    __m128d cx = _mm_set1_pd(parms.cx), cy = _mm_set1_pd(parms.cy), two = _mm_set1_pd(2.0);
+    __m128 ns = _mm_add_ps(s, n), ew = _mm_add_ps(e, w);
+    __m128d lo, hi;
+
+    lo = _mm_add_pd(_mm_add_pd(_mm_cvtps_pd(c),
+                               _mm_mul_pd(cx, _mm_sub_pd(_mm_cvtps_pd(ns), _mm_mul_pd(two, _mm_cvtps_pd(c))))),
+                    _mm_mul_pd(cy, _mm_sub_pd(_mm_cvtps_pd(ew), _mm_mul_pd(two, _mm_cvtps_pd(c)))));
+    c = _mm_movehl_ps(c, c);
+    ns = _mm_movehl_ps(ns, ns);
+    ew = _mm_movehl_ps(ew, ew);
+    hi = _mm_add_pd(_mm_add_pd(_mm_cvtps_pd(c),
+                               _mm_mul_pd(cx, _mm_sub_pd(_mm_cvtps_pd(ns), _mm_mul_pd(two, _mm_cvtps_pd(c))))),
+                    _mm_mul_pd(cy, _mm_sub_pd(_mm_cvtps_pd(ew), _mm_mul_pd(two, _mm_cvtps_pd(c)))));
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+#endif
+
+static inline void streamRow(int ix, int y0, int y1, int ld, const float *restrict u1, float *restrict u2,
+                             const float *restrict above, const float *restrict below)
+{
+#ifdef __SSE2__
+    int iy = y0;
+    const float *restrict row = u1 + ix*ld;
+    float *restrict out = u2 + ix*ld;
+
+    for (; iy <= y1 && ((uintptr_t)(out+iy) & 15); iy++)
+        out[iy] = stencil(row[iy], above[iy], below[iy], row[iy-1], row[iy+1]);
+    for (; iy+3 <= y1; iy += 4)
+        _mm_stream_ps(out+iy, stencil4(_mm_loadu_ps(row+iy), _mm_loadu_ps(above+iy), _mm_loadu_ps(below+iy),
+                                       _mm_loadu_ps(row+iy-1), _mm_loadu_ps(row+iy+1)));
+    for (; iy <= y1; iy++)
+        out[iy] = stencil(row[iy], above[iy], below[iy], row[iy-1], row[iy+1]);
+#else
+    updateRow(ix, y0, y1, ld, u1, u2, above, below);
+#endif
+}
+
+/**************************************************************************
+ *  subroutine jamRows
+/// updates the jam rows ix..ix+jam-1 (jam at most JAMMAX) from column y0
+/// to y1 in one sweep: every column of the jam+2 rows they read is loaded
+/// once and used by all the rows next to it, instead of three times, once
+/// for each row (unroll and jam). Only called with constant jam, so the
+/// rows are unrolled. With stream set the new values are written with
+/// non-temporal stores, like streamRow. Rows ix-1 and ix+jam must be
+/// rows of u1.
+ ****************************************************************************/
+static inline void jamRows(int ix, const int jam, int y0, int y1, int ld, const float *restrict u1, float *restrict u2,
+                           int stream)
+{
+    int iy = y0, j;
+    const float *restrict in = u1 + (ix-1)*ld;      /* the row above the first one */
+    float *restrict out = u2 + ix*ld;
+    float col[JAMMAX+2];
+
+#ifdef __SSE2__
+    __m128 v[JAMMAX+2];
+
+    if (stream){
+        for (; iy <= y1 && ((uintptr_t)(out+iy) & 15); iy++)
+            for (j = 0; j < jam; j++)
+                out[j*ld+iy] = stencil(in[(j+1)*ld+iy], in[j*ld+iy], in[(j+2)*ld+iy], in[(j+1)*ld+iy-1], in[(j+1)*ld+iy+1]);
+        for (; iy+3 <= y1; iy += 4){
+            for (j = 0; j < jam+2; j++)
+                v[j] = _mm_loadu_ps(in+j*ld+iy);
+            for (j = 0; j < jam; j++)
+                _mm_stream_ps(out+j*ld+iy, stencil4(v[j+1], v[j], v[j+2],
+                                                   _mm_loadu_ps(in+(j+1)*ld+iy-1), _mm_loadu_ps(in+(j+1)*ld+iy+1)));
+        }
+    }
+#endif
+    for (; iy <= y1; iy++){
+        for (j = 0; j < jam+2; j++)
+            col[j] = in[j*ld+iy];
+        for (j = 0; j < jam; j++)
+            out[j*ld+iy] = stencil(col[j+1], col[j], col[j+2], in[(j+1)*ld+iy-1], in[(j+1)*ld+iy+1]);
+    }
+}
+
+/* Orders the non-temporal stores of a sweep before whatever comes after it, like sending the rows */
+static inline void streamFence(void)
+{
+#ifdef __SSE2__
+    _mm_sfence();
+#endif
+}
+
+/**************************************************************************
+ *  subroutine updateExternal
+/// updates the first/last row and column of the block. up, down, left and
+/// right tell if the block has a neighbor on that side. Rows and columns
+/// without a neighbor are the boundary of the whole grid, so they are not
+/// calculated. The neighbors' values are read straight from the receive
+/// buffers in halo.
+/// The new first/last column is also packed into packleft/packright
+/// (indexed 1..rows), so it can be sent without a strided datatype.
+/// It is only called with constant positions (see EXTERNAL_KERNEL), so
+/// every position of a block gets its own copy without branches.
+ ****************************************************************************/
+static inline void updateExternal(int rows, int columns, int ld, const float *restrict u1, float *restrict u2,
+                                  const struct Halo *halo, float *restrict packleft, float *restrict packright,
+                                  const int up, const int down, const int left, const int right)
+{
+    int ny = ld;
+
+    if (up)
+        updateRow(1, 2, columns-1, ld, u1, u2, halo->up, u1+2*ny);
+    if (down)
+        updateRow(rows, 2, columns-1, ld, u1, u2, u1+(rows-1)*ny, halo->down);
+    if (left)
+        updateColumn(1, 2, rows-1, ld, u1, u2, halo->left, -1, packleft);
+    if (right)
+        updateColumn(columns, 2, rows-1, ld, u1, u2, halo->right, 1, packright);
+
+    /* Corners */
+    if (up && left)
+        u2[ny+1] = stencil(u1[ny+1], halo->up[1], u1[2*ny+1], halo->left[1], u1[ny+2]);
+    if (up && right)
+        u2[ny+columns] = stencil(u1[ny+columns], halo->up[columns], u1[2*ny+columns], u1[ny+columns-1], halo->right[1]);
+    if (down && left)
+        u2[rows*ny+1] = stencil(u1[rows*ny+1], u1[(rows-1)*ny+1], halo->down[1], halo->left[rows], u1[rows*ny+2]);
+    if (down && right)
+        u2[rows*ny+columns] = stencil(u1[rows*ny+columns], u1[(rows-1)*ny+columns], halo->down[columns], u1[rows*ny+columns-1], halo->right[rows]);
+
+    if (left){
+        packleft[1] = u2[ny+1];
+        packleft[rows] = u2[rows*ny+1];
+    }
+    if (right){
+        packright[1] = u2[ny+columns];
+        packright[rows] = u2[rows*ny+columns];
+    }
+}
+
+/**************************************************************************
+ *  subroutine updateBlock
+/// updates the whole block in one pass, row by row, reading the neighbors'
+/// values from halo. Like updateExternal it skips the rows and columns
+/// without a neighbor and packs the new first/last column. Meant for blocks
+/// too small for the interior to hide the exchange. With stream set the
+/// rows are written with non-temporal stores (see streamRow).
+ ****************************************************************************/
+static void updateBlock(int rows, int columns, int ld, const float *restrict u1, float *restrict u2,
+                        const struct Halo *halo, float *restrict packleft, float *restrict packright,
+                        int up, int down, int left, int right, int stream)
+{
+    int ix, ny = ld;
+    const float *above, *below;
+
+    for (ix = up ? 1 : 2; ix <= (down ? rows : rows-1); ix++){
+        above = (ix == 1) ? halo->up : u1+(ix-1)*ny;
+        below = (ix == rows) ? halo->down : u1+(ix+1)*ny;
+        if (left){
+            u2[ix*ny+1] = stencil(u1[ix*ny+1], above[1], below[1], halo->left[ix], u1[ix*ny+2]);
+            packleft[ix] = u2[ix*ny+1];
+        }
+        if (stream)
+            streamRow(ix, 2, columns-1, ld, u1, u2, above, below);
+        else
+            updateRow(ix, 2, columns-1, ld, u1, u2, above, below);
+        if (right){
+            u2[ix*ny+columns] = stencil(u1[ix*ny+columns], above[columns], below[columns], u1[ix*ny+columns-1], halo->right[ix]);
+            packright[ix] = u2[ix*ny+columns];
+        }
+    }
+    if (stream)
+        streamFence();
+}
+
+/**************************************************************************
+ *  subroutine updateInPlace
+/// updateBlock with a single grid u: the new values overwrite the old ones
+/// row by row. roll[0] and roll[1] (ld floats each) keep the old values of
+/// the row being updated and of the one above it, which the next row still
+/// reads. The row below is still old when its turn comes.
+ ****************************************************************************/
+static void updateInPlace(int rows, int columns, int ld, float *restrict u, const struct Halo *halo,
+                          float *restrict packleft, float *restrict packright, float *roll[2],
+                          int up, int down, int left, int right)
+{
+    int ix, iy, first = up ? 1 : 2;
+    float *above, *old, *row;
+    const float *below;
+
+    /* the row above the first one we update stays as it is */
+    above = roll[0];
+    old = roll[1];
+    if (first > 1)
+        memcpy(above, u+(first-1)*ld, (columns+2)*sizeof(float));
+
+    for (ix = first; ix <= (down ? rows : rows-1); ix++){
+        row = u+ix*ld;
+        memcpy(old, row, (columns+2)*sizeof(float));
+        below = (ix == rows) ? halo->down : u+(ix+1)*ld;
+        if (ix == 1)
+            above = (float *)halo->up;
+        if (left){
+            row[1] = stencil(old[1], above[1], below[1], halo->left[ix], old[2]);
+            packleft[ix] = row[1];
+        }
+        for (iy = 2; iy <= columns-1; iy++)
+            row[iy] = stencil(old[iy], above[iy], below[iy], old[iy-1], old[iy+1]);
+        if (right){
+            row[columns] = stencil(old[columns], above[columns], below[columns], old[columns-1], halo->right[ix]);
+            packright[ix] = row[columns];
+        }
+
+        /* the old row becomes the one above, the other buffer takes the next one */
+        above = old;
+        old = (old == roll[0]) ? roll[1] : roll[0];
+    }
+}
+
+/* One row of a tile, all TILE points of it, with the points left and right of it read from row[-1]
+ * and row[TILE] */
+static inline void tileRow(const float *restrict row, const float *restrict above, const float *restrict below,
+                           float *restrict out)
+{
+    int c;
+    for (c = 0; c < TILE; c++)
+        out[c] = stencil(row[c], above[c], below[c], row[c-1], row[c+1]);
+}
+
+/**************************************************************************
+ *  subroutine updateTiled
+/// updateBlock for the tiled layout (see struct Tiled): updates the tiles
+/// in the order they are stored, each one row by row. The points next to a
+/// tile come from the tiles around it, or from halo at the edges of the
+/// block, and are skipped like in updateBlock where there is no neighbor.
+/// The edges to send are packed afterwards by tiledPack.
+ ****************************************************************************/
+static void updateTiled(const struct Tiled *t, const float *restrict u1, float *restrict u2, const struct Halo *halo,
+                        int up, int down, int left, int right)
+{
+    int k, id, ti, tj, x0, y0, x1, y1, ix, c, first, last, r;
+    const float *tile, *top, *bottom, *west, *east, *row, *above, *below;
+    float *out;
+
+    for (k = 0; k < t->tr*t->tc; k++){
+        id = t->order[k];
+        ti = id / t->tc;
+        tj = id % t->tc;
+        x0 = ti*TILE + 1;
+        y0 = tj*TILE + 1;
+        x1 = (x0+TILE-1 < t->rows) ? x0+TILE-1 : t->rows;
+        y1 = (y0+TILE-1 < t->columns) ? y0+TILE-1 : t->columns;
+
+        /* the tile, and what is around it: the row above and below it, indexed like its rows, and the
+         * column left and right of it, TILE floats apart like its columns (NULL where that is a halo) */
+        tile = u1 + t->offset[id];
+        out = u2 + t->offset[id];
+        top = (ti > 0) ? u1 + t->offset[id-t->tc] + (TILE-1)*TILE : halo->up + y0;
+        bottom = (ti < t->tr-1) ? u1 + t->offset[id+t->tc] : halo->down + y0;
+        west = (tj > 0) ? u1 + t->offset[id-1] + TILE-1 : NULL;
+        east = (tj < t->tc-1) ? u1 + t->offset[id+1] : NULL;
+
+        /* columns of this tile to update, counted from its first one */
+        first = (y0 == 1 && !left) ? 1 : 0;
+        last = ((y1 == t->columns && !right) ? y1-1 : y1) - y0;
+
+        for (ix = (x0 == 1 && !up) ? 2 : x0; ix <= ((x1 == t->rows && !down) ? x1-1 : x1); ix++){
+            r = ix - x0;
+            row = tile + r*TILE;
+            above = (r > 0) ? row - TILE : top;
+            below = (ix < x1) ? row + TILE : bottom;
+
+            /* Whole tile rows are done as one vector loop of constant length, which reads one point
+             * before and after the row (see the padding of the tiles in main), and then the points at
+             * its ends are done again with their real neighbors. */
+            if (first == 0 && last == TILE-1){
+                tileRow(row, above, below, out + r*TILE);
+                out[r*TILE] = stencil(row[0], above[0], below[0], west ? west[r*TILE] : halo->left[ix], row[1]);
+                out[r*TILE+TILE-1] = stencil(row[TILE-1], above[TILE-1], below[TILE-1], row[TILE-2],
+                                             east ? east[r*TILE] : halo->right[ix]);
+            }
+            else
+                for (c = first; c <= last; c++)
+                    out[r*TILE+c] = stencil(row[c], above[c], below[c],
+                                            c > 0 ? row[c-1] : (west ? west[r*TILE] : halo->left[ix]),
+                                            c < y1-y0 ? row[c+1] : (east ? east[r*TILE] : halo->right[ix]));
+        }
+    }
+}
+
+/* One copy of updateExternal for every block position: the 4 corners, the 4 edges and the inside
+ * of the block grid, plus the ones of 1 x n and n x 1 block grids */
+#define EXTERNAL_KERNEL(up, down, left, right) \
+    static void updateExternal##up##down##left##right(int rows, int columns, int ld, const float *restrict u1, float *restrict u2, \
+                                                      const struct Halo *halo, float *restrict packleft, float *restrict packright) \
+    { updateExternal(rows, columns, ld, u1, u2, halo, packleft, packright, up, down, left, right); }
+
+EXTERNAL_KERNEL(0,0,0,0)
+EXTERNAL_KERNEL(1,0,0,0)
+EXTERNAL_KERNEL(0,1,0,0)
+EXTERNAL_KERNEL(1,1,0,0)
+EXTERNAL_KERNEL(0,0,1,0)
+EXTERNAL_KERNEL(1,0,1,0)
+EXTERNAL_KERNEL(0,1,1,0)
+EXTERNAL_KERNEL(1,1,1,0)
+EXTERNAL_KERNEL(0,0,0,1)
+EXTERNAL_KERNEL(1,0,0,1)
+EXTERNAL_KERNEL(0,1,0,1)
+EXTERNAL_KERNEL(1,1,0,1)
+EXTERNAL_KERNEL(0,0,1,1)
+EXTERNAL_KERNEL(1,0,1,1)
+EXTERNAL_KERNEL(0,1,1,1)
+EXTERNAL_KERNEL(1,1,1,1)
+
+/* Indexed by (up) | (down)<<1 | (left)<<2 | (right)<<3, where each one is 1 if there is a neighbor there */
+static void (*const externalKernel[16])(int, int, int, const float *restrict, float *restrict, const struct Halo *, float *restrict, float *restrict) = {
+    updateExternal0000,
+    updateExternal1000,
+    updateExternal0100,
+    updateExternal1100,
+    updateExternal0010,
+    updateExternal1010,
+    updateExternal0110,
+    updateExternal1110,
+    updateExternal0001,
+    updateExternal1001,
+    updateExternal0101,
+    updateExternal1101,
+    updateExternal0011,
+    updateExternal1011,
+    updateExternal0111,
+    updateExternal1111
+};
+
+void inidat(), prtdat(), updateInternal(),  myprint(), DUMMYDUMDUM();
+int malloc2darr(),isPrime(),checkSize(),leadingDimension();
 
 int main (int argc, char *argv[]){
     float **local[2];               /* stores the block assigned to current task, surrounded by halo points */
@@ -55,10 +565,22 @@ int main (int argc, char *argv[]){
         msgtype,                    /* for message types */
         xdim, ydim,                 /* dimensions of grid partition (e.x. 4x4) */
         rows, columns,              /* number of rows/columns of each block (e.x. 20x12) */
+        pipeline=OVERLAP,           /* order of communication and calculation in a step */
+        backend=P2P_BACKEND,        /* how the halos are exchanged */
+        precision=FP32,             /* precision of the halo messages */
+        bits=7,                     /* mantissa bits of the DELTA precision */
+        ld,                         /* floats from a row of local to the next */
+        grids,                      /* full grids kept: 2, or 1 for the in place pipeline */
+        layout=ROWMAJOR,            /* how the points of the block are stored */
+        stream=STREAM_AUTO,         /* non-temporal stores in the sweeps over the grid */
+        jam=JAMMAX,                 /* rows of the interior calculated in one sweep */
+        hugepages=0,                /* back the arena with transparent huge pages */
+        bind=0,                     /* bind the arena to the NUMA node the task starts on */
         i,j,x,y,ix,iy,iz,it;        /* loop variables */
     double start,finish;
     char inputfile[80] = "initial.dat";
     char outputfile[80] = "final.dat";
+    char exactfile[80] = "";        /* output of a run with exact halos, for the accuracy report */
     MPI_Status status;
 
     /* Read arguments */
@@ -67,6 +589,85 @@ int main (int argc, char *argv[]){
             strcpy(inputfile,argv[i+1]);
         if(!strcmp(argv[i],"-o"))
             strcpy(outputfile,argv[i+1]);
+        if(!strcmp(argv[i],"-p")){
+            if (!strcmp(argv[i+1],"overlap"))
+                pipeline = OVERLAP;
+            else if (!strcmp(argv[i+1],"first"))
+                pipeline = FIRST;
+            else if (!strcmp(argv[i+1],"plain"))
+                pipeline = PLAIN;
+            else if (!strcmp(argv[i+1],"auto"))
+                pipeline = AUTO;
+            else if (!strcmp(argv[i+1],"inplace"))
+                pipeline = INPLACE;
+            else{
+                printf("ERROR: unknown pipeline %s (use overlap, first, plain, auto or inplace)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-x")){
+            for (backend=0; backend<=AUTO_BACKEND; backend++)
+                if (!strcmp(argv[i+1],backendName[backend]))
+                    break;
+            if (backend > AUTO_BACKEND){
+                printf("ERROR: unknown exchange %s (use p2p, persistent, neighbor, rma, shm or auto)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-q")){
+            if (!strcmp(argv[i+1],"fp32"))
+                precision = FP32;
+            else if (!strcmp(argv[i+1],"fp16"))
+                precision = FP16;
+            else if (!strcmp(argv[i+1],"bf16"))
+                precision = BF16;
+            else if (!strcmp(argv[i+1],"delta"))
+                precision = DELTA;
+            else{
+                printf("ERROR: unknown precision %s (use fp32, fp16, bf16 or delta)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-m"))
+            bits = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-e"))
+            strcpy(exactfile,argv[i+1]);
+        if(!strcmp(argv[i],"-H"))
+            hugepages = 1;
+        if(!strcmp(argv[i],"-B"))
+            bind = 1;
+        if(!strcmp(argv[i],"-L")){
+            if (!strcmp(argv[i+1],"rows"))
+                layout = ROWMAJOR;
+            else if (!strcmp(argv[i+1],"tiled"))
+                layout = TILED;
+            else{
+                printf("ERROR: unknown layout %s (use rows or tiled)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-N")){
+            if (!strcmp(argv[i+1],"off"))
+                stream = STREAM_OFF;
+            else if (!strcmp(argv[i+1],"on"))
+                stream = STREAM_ON;
+            else if (!strcmp(argv[i+1],"auto"))
+                stream = STREAM_AUTO;
+            else{
+                printf("ERROR: unknown store mode %s (use off, on or auto)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-J"))
+            jam = strtol(argv[i+1], NULL, 10);
+    }
+    if (bits < 0 || bits > 7){
+        printf("ERROR: the delta precision keeps 0 to 7 mantissa bits\n");
+        exit(22);
+    }
+    if (jam != 1 && jam != 2 && jam != 4){
+        printf("ERROR: the interior is calculated 1, 2 or 4 rows at a time\n");
+        exit(22);
     }
 
     /* First, find out my taskid and how many tasks are running */
@@ -132,6 +733,8 @@ int main (int argc, char *argv[]){
         rows = NXPROB / xdim;
         columns = NYPROB / ydim;
         printf("Each block is %d x %d.\n",rows,columns);
+        if (layout == TILED && pipeline != PLAIN)
+            printf("The tiled layout is updated with the plain pipeline.\n");
 
         /* Distribute work to workers.*/ 
         for (i=1; i<numworkers; i++){
@@ -200,15 +803,88 @@ int main (int argc, char *argv[]){
     int dim[2] = {xdim,ydim}, period[2] = {0,0};
     MPI_Cart_create(MPI_COMM_WORLD, 2, dim, period, 0, &comm_cart);
 
-    /* Allocate contigious memory for the 2d arrays local[0] and local[1] */
-    malloc2darr(&local[0], rows+2, columns+2);
-    malloc2darr(&local[1], rows+2, columns+2);
+    //----------------------------------------------------------------------------------------------------------------------------------------------
+    // The arena of this task. The tasks of a node must fit in the memory it has free, or we stop here.
+    //----------------------------------------------------------------------------------------------------------------------------------------------
+    struct Arena arena;
+    MPI_Comm node;
+    double need[2], most[2];        /* bytes of this node's arenas and free on this node */
+    double grid[2];                 /* bytes of this node's grids, and of its last level cache */
+    int noderank;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &noderank);
+    if (layout == TILED)
+        pipeline = PLAIN;
+    grids = (pipeline == INPLACE) ? 1 : 2;
+    need[0] = arenaSize(rows, columns, grids, layout, precision);
+    MPI_Allreduce(MPI_IN_PLACE, need, 1, MPI_DOUBLE, MPI_SUM, node);
+    need[1] = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+
+    /* The sweeps write a whole grid without reading it. If the grids the tasks of a node sweep over don't
+     * fit in its last level cache together, the new rows are written around the cache (-N auto): they
+     * would only be evicted before the next step reads them, after costing a read for the write allocate. */
+    grid[0] = (layout == ROWMAJOR) ? grids * (double)(rows+2) * leadingDimension(columns+2) * sizeof(float) : 0.0;
+    MPI_Allreduce(MPI_IN_PLACE, grid, 1, MPI_DOUBLE, MPI_SUM, node);
+    grid[1] = 0.0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    grid[1] = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (grid[1] <= 0)
+        grid[1] = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    MPI_Comm_free(&node);
+    if (need[0] > need[1]){
+        if (noderank == 0)
+            printf("ERROR: the tasks of a node need %.1f MB, but it has %.1f MB free\n", need[0]/1048576, need[1]/1048576);
+        MPI_Abort(MPI_COMM_WORLD, 22);
+    }
+    if (!arenaInit(&arena, arenaSize(rows, columns, grids, layout, precision), hugepages, bind)){
+        printf("ERROR: Process %d can't allocate its arena of %zu bytes\n", taskid, arenaSize(rows, columns, grids, layout, precision));
+        MPI_Abort(MPI_COMM_WORLD, 22);
+    }
+    MPI_Reduce(need, most, 2, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+    if (taskid == MASTER)
+        printf("Arena: %zu bytes per task, %.1f MB on the fullest node, which has %.1f MB free\n",
+               arena.size, most[0]/1048576, most[1]/1048576);
+
+    /* The fullest node decides, and an unknown cache size keeps the normal stores. So does a jammed
+     * interior: it writes jam rows at once, which measured faster through the cache than as that many
+     * non-temporal streams. The in place update reads every row just before it writes it and the tiled
+     * one has its own kernel, so neither streams. */
+    MPI_Allreduce(MPI_IN_PLACE, grid, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    if (stream == STREAM_AUTO)
+        stream = (grid[1] > 0 && grid[0] > grid[1] && jam == 1) ? STREAM_ON : STREAM_OFF;
+    if (pipeline == INPLACE || layout == TILED)
+        stream = STREAM_OFF;
+    if (taskid == MASTER)
+        printf("Stores: %s (grids of %.1f MB on the fullest node, last level cache of %.1f MB)\n",
+               stream == STREAM_ON ? "non-temporal" : "normal", grid[0]/1048576, grid[1]/1048576);
+
+    /* Allocate contigious memory for the 2d arrays local[0] and local[1]. Their rows are ld floats apart,
+     * which may be more than columns+2 (see malloc2darr). The in place pipeline has only one: both are
+     * the same array, and iz stays 0. The tiled layout keeps its two grids in tiles[] instead. */
+    struct Tiled tl;
+    float *tiles[2];
+    ld = leadingDimension(columns+2);
+    if (layout == TILED){
+        tiledInit(&tl, rows, columns, &arena);
+        /* with a cache line before and after the tiles, which updateTiled may read but never uses */
+        for (iz=0 ; iz < 2 ; iz++)
+            tiles[iz] = (float*)arenaAlloc(&arena, tl.tr*tl.tc*TILE*TILE*sizeof(float) + 2*ALIGN) + ALIGN/sizeof(float);
+    }
+    else{
+        malloc2darr(&local[0], rows+2, columns+2, &ld, &arena);
+        if (grids == 2)
+            malloc2darr(&local[1], rows+2, columns+2, &ld, &arena);
+        else
+            local[1] = local[0];
+    }
+
+    /* Two rows for the in place update to keep the old values of the rows it overwrites, and for reading
+     * a file a row at a time */
+    float *roll[2] = {(float*)arenaAlloc(&arena, ld*sizeof(float)), (float*)arenaAlloc(&arena, ld*sizeof(float))};
 
-    /* Initialize with 0's */
-    for (iz=0; iz<2; iz++)
-        for (ix=0; ix<rows+2; ix++) 
-            for (iy=0; iy<columns+2; iy++) 
-                local[iz][ix][iy] = 0.0;
+    /* They start with 0's, like everything from the arena */
 
     /* Preparing the datatypes for Parallel I/O */
 
@@ -223,7 +899,7 @@ int main (int argc, char *argv[]){
     MPI_Type_commit(&sendsubarrtype);
 
     /* Define the datatype of receive buffer elements */
-    int recvsizes[2]    = {rows+2, columns+2};         /* local array size */
+    int recvsizes[2]    = {rows+2, ld};                /* local array size, with the padding */
     int recvsubsizes[2] = {rows, columns};          /* local size without halo */
     int recvstarts[2]   = {1,1};
 
@@ -239,8 +915,16 @@ int main (int argc, char *argv[]){
     MPI_Offset disp = ((taskid/ydim)*rows*NYPROB + taskid%ydim*columns)*sizeof(float);
     MPI_File_set_view(fh, disp, MPI_FLOAT, sendsubarrtype, "native", MPI_INFO_NULL);
 
-    /* Read from the file */
-    MPI_File_read(fh, &(local[0][0][0]), 1, recvsubarrtype, &status);
+    /* Read from the file. The tiled layout reads a row at a time and scatters it to the tiles. */
+    if (layout == TILED){
+        MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+        for (ix=1; ix<=rows; ix++){
+            MPI_File_read_at(fh, disp + (MPI_Offset)(ix-1)*NYPROB*sizeof(float), roll[0], columns, MPI_FLOAT, &status);
+            tiledRow(&tl, tiles[0], ix, roll[0], 1);
+        }
+    }
+    else
+        MPI_File_read(fh, &(local[0][0][0]), 1, recvsubarrtype, &status);
     MPI_File_close(&fh);
 
     /// *** WORK STARTS HERE *** ///
@@ -251,67 +935,239 @@ int main (int argc, char *argv[]){
 
     iz = 0;
 
-    MPI_Request RRequestR, RRequestL, RRequestU, RRequestD;
-    MPI_Request SRequestR, SRequestL, SRequestU, SRequestD;
+    /* Contiguous copies of the first/last column of each domain, indexed 1..rows. The edge kernel fills
+     * them while it calculates the columns; the ones of the initial data are copied here. The tiled
+     * layout has no contiguous rows either, so it packs the first/last row too (indexed 1..columns). */
+    float *packleft[2], *packright[2], *packup[2], *packdown[2];
+    for (iz=0 ; iz < 2 ; iz++){
+        packleft[iz] = (float*)arenaAlloc(&arena, (rows+2)*sizeof(float));
+        packright[iz] = (float*)arenaAlloc(&arena, (rows+2)*sizeof(float));
+    }
+    if (layout == TILED){
+        for (iz=0 ; iz < 2 ; iz++){
+            packup[iz] = (float*)arenaAlloc(&arena, (columns+2)*sizeof(float));
+            packdown[iz] = (float*)arenaAlloc(&arena, (columns+2)*sizeof(float));
+        }
+        tiledPack(&tl, tiles[0], packup[0], packdown[0], packleft[0], packright[0]);
+    }
+    else
+        for (ix=1; ix<=rows; ix++){
+            packleft[0][ix] = local[0][ix][1];
+            packright[0][ix] = local[0][ix][columns];
+        }
+
+    /* The halos are received in contiguous buffers and the edge kernel reads them from there,
+     * so the halo points of local are never used. The four buffers are one allocation, so the
+     * RMA backend can expose them as one window. */
+    struct Halo halo;
+    float *halobuf = (float*)arenaAlloc(&arena, (2*(columns+2) + 2*(rows+2))*sizeof(float));
+    halo.up = halobuf;
+    halo.down = halo.up + columns+2;
+    halo.left = halo.down + columns+2;
+    halo.right = halo.left + rows+2;
+
+    /* What the exchange sends from each domain and where it receives, by side */
+    struct Exchange ex;
+    int nb[4] = {up, down, left, right};
+    float *send[2][4];
+    for (iz=0 ; iz < 2 ; iz++){
+        send[iz][UP] = (layout == TILED) ? &packup[iz][1] : &local[iz][1][1];
+        send[iz][DOWN] = (layout == TILED) ? &packdown[iz][1] : &local[iz][rows][1];
+        send[iz][LEFT] = &packleft[iz][1];
+        send[iz][RIGHT] = &packright[iz][1];
+    }
 
-    /* Datatypes for matrix column */
-    MPI_Datatype column; 
-    MPI_Type_vector(rows, 1,columns+2, MPI_FLOAT, &column);
-    MPI_Type_commit(&column);
+    /* With reduced precision the exchange moves the codes instead */
+    struct Reduced q;
+    reducedInit(&q, precision, bits, rows, columns, send, &halo, &arena);
+    float *(*xsend)[4] = (precision == FP32) ? send : q.code;
+    struct Halo *xhalo = (precision == FP32) ? &halo : &q.stage;
+    MPI_Datatype elem = (precision == FP32) ? MPI_FLOAT : MPI_UNSIGNED_SHORT;
+
+    if (backend == AUTO_BACKEND){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Calibration: time TRIALS exchanges of domain 0 with every backend that works here and keep the fastest. Domain 0
+        // holds the initial data, so the halos they leave behind are the ones the first step needs anyway.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        double t, slowest, best = 0.0;
+        int b;
+        for (b=0; b<AUTO_BACKEND; b++){
+            if (!exchangeInit(&ex, b, nb, rows, columns, elem, xsend, xhalo, comm_cart))
+                continue;
+            ex.start(&ex, 0);
+            ex.finish(&ex);
+            MPI_Barrier(comm_cart);
+            t = MPI_Wtime();
+            for (i=0; i<TRIALS; i++){
+                ex.start(&ex, 0);
+                ex.finish(&ex);
+            }
+            t = (MPI_Wtime() - t)/TRIALS;
+            MPI_Allreduce(&t, &slowest, 1, MPI_DOUBLE, MPI_MAX, comm_cart);
+            if (taskid == MASTER)
+                printf("Exchange %-10s %e secs\n", ex.name, slowest);
+            if (backend == AUTO_BACKEND || slowest < best){
+                backend = b;
+                best = slowest;
+            }
+            ex.free(&ex);
+        }
+    }
+    if (!exchangeInit(&ex, backend, nb, rows, columns, elem, xsend, xhalo, comm_cart)){
+        if (taskid == MASTER)
+            printf("ERROR: the %s halo exchange doesn't work with these tasks\n", backendName[backend]);
+        MPI_Abort(MPI_COMM_WORLD, 22);
+        exit(22);
+    }
+    if (taskid == MASTER)
+        printf("Using the %s halo exchange.\n", ex.name);
+
+    /* The halos of step 0 */
+    haloStart(&ex, &q, 0);
+    haloFinish(&ex, &q);
+
+    /* Choose the kernel of the edges for the position of this block */
+    void (*updateEdges)(int, int, int, const float *restrict, float *restrict, const struct Halo *, float *restrict, float *restrict) =
+        externalKernel[(up != MPI_PROC_NULL) | (down != MPI_PROC_NULL)<<1 | (left != MPI_PROC_NULL)<<2 | (right != MPI_PROC_NULL)<<3];
+
+    int hasup = (up != MPI_PROC_NULL), hasdown = (down != MPI_PROC_NULL),
+        hasleft = (left != MPI_PROC_NULL), hasright = (right != MPI_PROC_NULL);
+
+    if (pipeline == AUTO){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Predict one step of each path from a few measurements: the exchange (with the backend chosen above), the
+        // interior, the edges, and the whole block in one pass. They write local[1] and the packs of domain 1, which
+        // the first step writes again. Overlap takes max(exchange, interior) + edges, plain takes exchange + whole block.
+        // The slowest task decides for everybody.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        double t, texchange, tinterior, tedges, tblock, predicted[2], slowest[2];
+
+        MPI_Barrier(comm_cart);
+        t = MPI_Wtime();
+        for (i=0; i<TRIALS; i++){
+            ex.start(&ex, 0);
+            ex.finish(&ex);
+        }
+        texchange = (MPI_Wtime() - t)/TRIALS;
+
+        t = MPI_Wtime();
+        for (i=0; i<TRIALS; i++)
+            updateInternal(2, rows-1, columns, ld, &local[0][0][0], &local[1][0][0], stream, jam);
+        tinterior = (MPI_Wtime() - t)/TRIALS;
+
+        t = MPI_Wtime();
+        for (i=0; i<TRIALS; i++)
+            updateEdges(rows, columns, ld, &local[0][0][0], &local[1][0][0], &halo, packleft[1], packright[1]);
+        tedges = (MPI_Wtime() - t)/TRIALS;
+
+        t = MPI_Wtime();
+        for (i=0; i<TRIALS; i++)
+            updateBlock(rows, columns, ld, &local[0][0][0], &local[1][0][0], &halo, packleft[1], packright[1],
+                        hasup, hasdown, hasleft, hasright, stream);
+        tblock = (MPI_Wtime() - t)/TRIALS;
+
+        predicted[0] = (texchange > tinterior ? texchange : tinterior) + tedges;
+        predicted[1] = texchange + tblock;
+        MPI_Allreduce(predicted, slowest, 2, MPI_DOUBLE, MPI_MAX, comm_cart);
+        pipeline = (slowest[1] < slowest[0]) ? PLAIN : OVERLAP;
+        if (taskid == MASTER)
+            printf("Predicted step: overlap %e secs, plain %e secs. Using %s.\n",
+                   slowest[0], slowest[1], pipeline == PLAIN ? "plain" : "overlap");
+    }
+    iz = 0;
+    if (layout == TILED){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Tiled: the plain pipeline on the tiled layout. The new edges are packed after the update, for the next exchange.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        for (it = 1; it <= STEPS; it++){
 
-    /* Requests for persistent communication */
-    MPI_Request req[16];
-    MPI_Status  stat[16];
+            /// *** COMMUNICATION *** ///
+            haloStart(&ex, &q, iz);
+            haloFinish(&ex, &q);
 
-    for (iz=0 ; iz < 2 ; iz++){
-        MPI_Recv_init(&(local[iz][1][0]), 1, column, left, 0, comm_cart, &(req[iz*8+0]));
-        MPI_Recv_init(&(local[iz][1][columns+1]), 1, column, right, 0, comm_cart, &(req[iz*8+1]));
-        MPI_Recv_init(&(local[iz][rows+1][1]), columns, MPI_FLOAT, down, 0, comm_cart, &(req[iz*8+2])); 
-        MPI_Recv_init(&(local[iz][0][1]), columns, MPI_FLOAT, up,0, comm_cart, &(req[iz*8+3])); 
+            /// *** CALCULATION *** ///
+            updateTiled(&tl, tiles[iz], tiles[1-iz], &halo, hasup, hasdown, hasleft, hasright);
+            tiledPack(&tl, tiles[1-iz], packup[1-iz], packdown[1-iz], packleft[1-iz], packright[1-iz]);
 
-        MPI_Send_init(&(local[iz][1][columns]), 1, column, right, 0, comm_cart, &req[iz*8+4]);
-        MPI_Send_init(&(local[iz][1][1]), 1, column, left , 0, comm_cart, &req[iz*8+5]);
-        MPI_Send_init(&(local[iz][1][1]), columns, MPI_FLOAT, up, 0, comm_cart, &req[iz*8+6]);
-        MPI_Send_init(&(local[iz][rows][1]), columns, MPI_FLOAT, down ,0, comm_cart, &req[iz*8+7]);
+            iz = 1-iz;
+        }
     }
-    
-    MPI_Startall(16,req);
-    MPI_Waitall(16,req,MPI_STATUS_IGNORE);
+    else if (pipeline == INPLACE){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // In place: the plain pipeline with one grid. The exchange is over before the update starts, so the edges can be
+        // sent straight from the grid; the sweep keeps the old values of the rows it overwrites in roll.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        for (it = 1; it <= STEPS; it++){
+
+            /// *** COMMUNICATION *** ///
+            haloStart(&ex, &q, 0);
+            haloFinish(&ex, &q);
+
+            /// *** CALCULATION *** ///
+            updateInPlace(rows, columns, ld, &local[0][0][0], &halo, packleft[0], packright[0], roll,
+                          hasup, hasdown, hasleft, hasright);
+        }
+    }
+    else if (pipeline == PLAIN){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Plain: exchange the halos, wait, then update the whole block in one pass. Nothing is overlapped, but there is
+        // only one sweep over the block.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        for (it = 1; it <= STEPS; it++){
+
+            /// *** COMMUNICATION *** ///
+            haloStart(&ex, &q, iz);
+            haloFinish(&ex, &q);
+
+            /// *** CALCULATION *** ///
+            updateBlock(rows, columns, ld, &local[iz][0][0], &local[1-iz][0][0], &halo, packleft[1-iz], packright[1-iz],
+                        hasup, hasdown, hasleft, hasright, stream);
+
+            iz = 1-iz;
+        }
+    }
+    else if (pipeline == FIRST){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Boundary first: the edges of the new step are calculated and sent before the interior, so each message has
+        // a whole interior sweep to arrive. The halos are used at the start of the next step. The halos of step 0 came
+        // with the exchange above.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        for (it = 1; it <= STEPS; it++){
 
-    iz = 0;
-    for (it = 1; it <= STEPS; it++){
+            if (it > 1)
+                haloFinish(&ex, &q);
 
-        /// *** RECEIVING PROCEDURES *** ///
-        MPI_Irecv(&(local[iz][1][0]), 1, column, left, 0, comm_cart, &RRequestL); ///WARNING: 0??
-        MPI_Irecv(&(local[iz][1][columns+1]), 1, column, right, 0, comm_cart, &RRequestR); ///WARNING: 0?
-        MPI_Irecv(&(local[iz][rows+1][1]), columns, MPI_FLOAT, down, 0, comm_cart, &RRequestD); ///WARNING: 0??
-        MPI_Irecv(&(local[iz][0][1]), columns, MPI_FLOAT, up,0, comm_cart, &RRequestU); ///WARNING: 0??
+            /// *** CALCULATION OF EXTERNAL DATA *** ///
+            updateEdges(rows, columns, ld, &local[iz][0][0], &local[1-iz][0][0], &halo, packleft[1-iz], packright[1-iz]);
 
-        /// *** SENDING PROCEDURES *** ///
-        MPI_Isend(&(local[iz][1][columns]), 1, column, right, 0, comm_cart, &SRequestR);  //sends column to RIGHT neighbor
-        MPI_Isend(&(local[iz][1][1]), 1, column, left , 0, comm_cart, &SRequestL);	//sends column to left neighbor
-        MPI_Isend(&(local[iz][1][1]), columns, MPI_FLOAT, up, 0, comm_cart, &SRequestU);  //sends to UP neighbor
-        MPI_Isend(&(local[iz][rows][1]), columns, MPI_FLOAT, down ,0, comm_cart, &SRequestD); //sends to DOWN neighbor
+            /// *** COMMUNICATION OF THE NEW EDGES *** ///
+            haloStart(&ex, &q, 1-iz);
+
+            /// *** CALCULATION OF INTERNAL DATA *** ///
+            updateInternal(2, rows-1, columns, ld, &local[iz][0][0], &local[1-iz][0][0], stream, jam);
+
+            iz = 1-iz; 
+        }
+
+        /* The halos of the last step are not needed, but they have to be received */
+        haloFinish(&ex, &q);
+    }
+    else
+    for (it = 1; it <= STEPS; it++){
+
+        /// *** COMMUNICATION *** ///
+        haloStart(&ex, &q, iz);
 
         /// *** CALCULATION OF INTERNAL DATA *** ///
-        updateInternal(2, rows-1, columns,&local[iz][0][0], &local[1-iz][0][0]); // 2 and xdim-3 because we want to calculate only internal nodes of the block.
+        updateInternal(2, rows-1, columns, ld, &local[iz][0][0], &local[1-iz][0][0], stream, jam); // 2 and xdim-3 because we want to calculate only internal nodes of the block.
         //line 0 contains neighbor's values and line 1 is the extrnal line of the block, so we don't want them. The same for the one before last and the last line.
 
-        if (right != MPI_PROC_NULL) MPI_Wait(&RRequestR , MPI_STATUS_IGNORE );
-        if (left != MPI_PROC_NULL) MPI_Wait(&RRequestL , MPI_STATUS_IGNORE );
-        if (up !=  MPI_PROC_NULL) MPI_Wait(&RRequestU , MPI_STATUS_IGNORE );
-        if (down !=  MPI_PROC_NULL) MPI_Wait(&RRequestD , MPI_STATUS_IGNORE );
+        haloFinish(&ex, &q);
 
         /// *** CALCULATION OF EXTERNAL DATA *** ///
-        updateExternal(1,rows, columns,right,left,up,down, &local[iz][0][0], &local[1-iz][0][0]);
+        updateEdges(rows, columns, ld, &local[iz][0][0], &local[1-iz][0][0], &halo, packleft[1-iz], packright[1-iz]);
 
         iz = 1-iz; 
-
-        if (right != MPI_PROC_NULL) MPI_Wait(&SRequestR , MPI_STATUS_IGNORE );
-        if (left != MPI_PROC_NULL) MPI_Wait(&SRequestL , MPI_STATUS_IGNORE );
-        if (up !=  MPI_PROC_NULL) MPI_Wait(&SRequestU , MPI_STATUS_IGNORE );
-        if (down !=  MPI_PROC_NULL) MPI_Wait(&SRequestD , MPI_STATUS_IGNORE );
-
 #if 0
         for ( i=0; i<numworkers; i++){
             if (taskid == i){
@@ -348,24 +1204,64 @@ int main (int argc, char *argv[]){
     /* Set view in order to define which portion of the file is visible to each worker */
     MPI_File_set_view(fh, disp, MPI_FLOAT, sendsubarrtype, "native", MPI_INFO_NULL);
 
-    /* Write to the file */
-    MPI_File_write(fh, &(local[iz][0][0]), 1, recvsubarrtype, &status);
+    /* Write to the file, a row at a time from the tiled layout */
+    if (layout == TILED){
+        MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+        for (ix=1; ix<=rows; ix++){
+            tiledRow(&tl, tiles[iz], ix, roll[0], 0);
+            MPI_File_write_at(fh, disp + (MPI_Offset)(ix-1)*NYPROB*sizeof(float), roll[0], columns, MPI_FLOAT, &status);
+        }
+    }
+    else
+        MPI_File_write(fh, &(local[iz][0][0]), 1, recvsubarrtype, &status);
     MPI_File_close(&fh);
 
     printf("Process:%d, Elapsed time: %e secs\n",taskid,finish-start);
 
-    /* Free malloc'd memory */
-    free2darr(&local[0]);
-    free2darr(&local[1]);
+    if (precision != FP32){
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Accuracy report: the error of the halo points as they were sent, and if we have the output of a run with exact
+        // halos (-e), the error of the final grid against it. The exact block is read a row at a time, there may be
+        // no second grid to hold it.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        double mine[2] = {q.maxerr, 0.0}, sums[3] = {q.sumerr, q.points, q.saturated}, all[3], worst[2];
+        int compared = exactfile[0] && checkSize(exactfile);
+
+        if (compared){
+            MPI_File_open(MPI_COMM_WORLD, exactfile, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+            for (ix=1; ix<=rows; ix++){
+                MPI_File_read_at(fh, disp + (MPI_Offset)(ix-1)*NYPROB*sizeof(float), roll[0], columns, MPI_FLOAT, &status);
+                if (layout == TILED)
+                    tiledRow(&tl, tiles[iz], ix, roll[1]+1, 0);
+                else
+                    memcpy(roll[1]+1, &local[iz][ix][1], columns*sizeof(float));
+                for (iy=1; iy<=columns; iy++)
+                    if (fabs(roll[1][iy] - roll[0][iy-1]) > mine[1])
+                        mine[1] = fabs(roll[1][iy] - roll[0][iy-1]);
+            }
+            MPI_File_close(&fh);
+        }
+        MPI_Reduce(mine, worst, 2, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+        MPI_Reduce(sums, all, 3, MPI_DOUBLE, MPI_SUM, MASTER, MPI_COMM_WORLD);
+        if (taskid == MASTER){
+            printf("Halo points sent: %.0f, max error %e, rms error %e", all[1], worst[0], all[1] > 0 ? sqrt(all[0]/all[1]) : 0.0);
+            if (precision == FP16)
+                printf(", %.0f out of the fp16 range", all[2]);
+            printf("\n");
+            if (compared)
+                printf("Final grid against %s: max error %e\n", exactfile, worst[1]);
+        }
+    }
+
+    /* Free the exchange, then the arena with all the buffers */
+    ex.free(&ex);
+    arenaFree(&arena);
 
     MPI_Type_free(&type);
     MPI_Type_free(&sendsubarrtype);
     MPI_Type_free(&recvsubarrtype);
-    MPI_Type_free(&column);
 
-    for(i=0; i<16 ; i++)
-        MPI_Request_free(&(req[i]));
-    
+
     MPI_Finalize();
     return 0;
 }
@@ -373,138 +1269,42 @@ int main (int argc, char *argv[]){
 /**************************************************************************
  *  subroutine update
 /// gets start = 2, end = xdim-1, ny = ydim = number of block columns without 
-/// the two which keep LEFT AND RIGHT neighbors' values
+/// the two which keep LEFT AND RIGHT neighbors' values, ld = floats from a
+/// row to the next, stream = write the rows with non-temporal stores (see
+/// streamRow), jam = rows calculated in one sweep (1, 2 or 4, see jamRows;
+/// the rows left over are done one at a time)
  ****************************************************************************/
-void updateInternal(int start, int end, int ny, float *u1, float *u2)
+void updateInternal(int start, int end, int ny, int ld, float *u1, float *u2, int stream, int jam)
 {
 
    int ix, iy;
+   for (ix = start; jam > 1 && ix+jam-1 <= end; ix += jam){
+      if (jam == 4)
+         jamRows(ix, 4, 2, ny-1, ld, u1, u2, stream);
+      else
+         jamRows(ix, 2, 2, ny-1, ld, u1, u2, stream);
+   }
+   start = ix;
+   if (stream){
+      for (ix = start; ix <= end; ix++)
+         streamRow(ix, 2, ny-1, ld, u1, u2, u1+(ix-1)*ld, u1+(ix+1)*ld);
+      streamFence();
+      return;
+   }
    for (ix = start; ix <= end; ix++){ 
       for (iy = 2; iy <= ny-1; iy++){
-         *(u2+ix*(ny+2)+iy) = *(u1+ix*(ny+2)+iy)  + 
-                          parms.cx * (*(u1+(ix+1)*(ny+2)+iy) +
-                          *(u1+(ix-1)*(ny+2)+iy) - 
-                          2.0 * *(u1+ix*(ny+2)+iy)) +
-                          parms.cy * (*(u1+ix*(ny+2)+iy+1) +
-                         *(u1+ix*(ny+2)+iy-1) - 
-                          2.0 * *(u1+ix*(ny+2)+iy));
+         *(u2+ix*ld+iy) = *(u1+ix*ld+iy)  + 
+                          parms.cx * (*(u1+(ix+1)*ld+iy) +
+                          *(u1+(ix-1)*ld+iy) - 
+                          2.0 * *(u1+ix*ld+iy)) +
+                          parms.cy * (*(u1+ix*ld+iy+1) +
+                         *(u1+ix*ld+iy-1) - 
+                          2.0 * *(u1+ix*ld+iy));
        }
     }
 }
 
 
-/**************************************************************************
- *  subroutine updateExternal
-///gets start = 1, end = xdim, ny= ydim = number of block columns without 
-///the two which keep LEFT AND RIGHT neighbors' values
- ****************************************************************************/
-void updateExternal(int start, int end, int ny,int right, int left,int up,int down, float *u1, float *u2)
-{
-    int ix, iy;
-    ny+=2;
-    end+=2;
-	/// *** CALCULATING FIRST EXTERNAL ROW *** ///
-    if (up != MPI_PROC_NULL) //this is because if the block haw not an up neighbor we shouldnt's caclulate halo
-       ix = start;
-    else
-	    ix = start+1;
-
-    if (left != MPI_PROC_NULL) //this is because if the block haw not a left neighbor we shouldnt's caclulate halo
-        iy = 1;
-    else
-        iy = 2;
-
-    int endny;
-    if (right !=  MPI_PROC_NULL)
-        endny = ny-3;
-    else
-        endny = ny-3;
-
-    for (; iy <= endny; iy++) 
-         *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + 
-                          parms.cx * (*(u1+(ix+1)*ny+iy) +
-                          *(u1+(ix-1)*ny+iy) - 
-                          2.0 * *(u1+ix*ny+iy)) +
-                          parms.cy * (*(u1+ix*ny+iy+1) +
-                         *(u1+ix*ny+iy-1) - 
-                          2.0 * *(u1+ix*ny+iy));
-
-	/// CALCULATING LAST EXTERNAL ROW *** ///
-    if (down != MPI_PROC_NULL)
-       ix =  end-2;
-    else
-	ix = end-3;
-    if (left != MPI_PROC_NULL) //this is because if the block haw not a left neighbor we shouldnt's caclulate halo
-        iy = 1;
-    else
-        iy = 2;
-    if (right !=  MPI_PROC_NULL)
-        endny = ny-2;
-    else
-        endny = ny-3;
-    for (; iy <= endny; iy++) 
-         *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + 
-                          parms.cx * (*(u1+(ix+1)*ny+iy) +
-                          *(u1+(ix-1)*ny+iy) - 
-                          2.0 * *(u1+ix*ny+iy)) +
-                          parms.cy * (*(u1+ix*ny+iy+1) +
-                         *(u1+ix*ny+iy-1) - 
-                          2.0 * *(u1+ix*ny+iy));
-	/// *** CALCULATING FIRST EXTERNAL COLUMN *** ///
-
-    if (up != MPI_PROC_NULL) //this is because if the block haw not an up neighbor we shouldnt's caclulate halo
-       ix = start;
-    else
-        ix = start+1;
-
-
-    if (left != MPI_PROC_NULL) //this is because if the block haw not a left neighbor we shouldnt's caclulate halo
-        iy = 1;
-    else
-        iy = 2;
-    
-    int endloop;
-    if (down != MPI_PROC_NULL)
-       endloop = end -2;
-    else
-       endloop = end -3; 
-
-    for (; ix<endloop; ix++)
-        *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + 
-                          parms.cx * (*(u1+(ix+1)*ny+iy) +
-                          *(u1+(ix-1)*ny+iy) - 
-                          2.0 * *(u1+ix*ny+iy)) +
-                          parms.cy * (*(u1+ix*ny+iy+1) +
-                         *(u1+ix*ny+iy-1) - 
-                          2.0 * *(u1+ix*ny+iy)); 
- /// *** CALCULATING LAST EXTERNAL COLUMN *** ///
-
-   if (up != MPI_PROC_NULL) //this is because if the block haw not an up neighbor we shouldnt's caclulate halo
-       ix = start;
-   else
-       ix = start+1; 
-
-   if (right != MPI_PROC_NULL)
-        iy = ny -2;
-    else 
-        iy = ny-3;
-
-    if (down != MPI_PROC_NULL)
-       endloop = end -2; //the down right corner is calculated from row calculation, so we don't need to calculate again
-    else 
-       endloop = end -3; // the down right corner is calculated from row calculation, so we don't need to calculate again
-    //printf("end =%d, endloop=%d\n\n", end, endloop);
-    for (; ix<endloop; ix++)
-       *(u2+ix*ny+iy) = *(u1+ix*ny+iy)  + parms.cx * (*(u1+(ix+1)*ny+iy) +
-                          *(u1+(ix-1)*ny+iy) - 
-                          2.0 * *(u1+ix*ny+iy)) +
-                          parms.cy * (*(u1+ix*ny+iy+1) +
-                         *(u1+ix*ny+iy-1) - 
-                          2.0 * *(u1+ix*ny+iy)); 
-
-}
-
-
 /*****************************************************************************
  *  subroutine inidat
  *****************************************************************************/
@@ -605,32 +1405,612 @@ int checkSize(const char *filename){
 }
 #endif 
 
-int malloc2darr(float ***array, int n, int m) {
+/**************************************************************************
+ *  subroutine leadingDimension
+/// floats from a row of m floats to the next: m rounded up to a cache line,
+/// plus one more line if a row would be a multiple of 1KB (power of two
+/// widths map the rows on the same cache sets)
+ ****************************************************************************/
+int leadingDimension(int m) {
+    int ld = (m + ALIGN/sizeof(float)-1) / (ALIGN/sizeof(float)) * (ALIGN/sizeof(float));
 
-    /* allocate the n*m contiguous items */
-    float *p = (float *)malloc(n*m*sizeof(float));
-    if (!p) return -1;
+    if ((ld * sizeof(float)) % 1024 == 0)
+        ld += ALIGN/sizeof(float);
+    return ld;
+}
 
-    /* allocate the row pointers into the memory */
-    (*array) = (float **)malloc(n*sizeof(float*));
-    if (!(*array)) {
-        free(p);
-        return -1;
-    }
+/**************************************************************************
+ *  subroutine malloc2darr
+/// takes n rows of m floats from arena, with the rows ld floats apart (see
+/// leadingDimension). Point [1][1], the first one of a block inside its
+/// halo, is cache line aligned, and so is point [ix][1] of every row.
+ ****************************************************************************/
+int malloc2darr(float ***array, int n, int m, int *ld, struct Arena *arena) {
+    float *p;
+
+    *ld = leadingDimension(m);
+
+    /* the n*ld contiguous items, shifted so that [1][1] starts a line */
+    p = (float *)arenaAlloc(arena, (n * *ld + ALIGN/sizeof(float)) * sizeof(float));
+    p += (ALIGN/sizeof(float) - (*ld+1) % (ALIGN/sizeof(float))) % (ALIGN/sizeof(float));
 
-    /* set up the pointers into the contiguous memory */
+    /* the row pointers into the memory */
+    (*array) = (float **)arenaAlloc(arena, n*sizeof(float*));
     for (int i=0; i<n; i++)
-        (*array)[i] = &(p[i*m]);
+        (*array)[i] = &(p[i * *ld]);
 
     return 0;
 }
 
-int free2darr(float ***array) {
-    /* free the memory - the first element of the array is at the start */
-    free(&((*array)[0][0]));
+/**************************************************************************
+ *  subroutine tiledInit
+/// sets up the tiled layout of a rows x columns block, with its tables
+/// from arena. The tiles are visited in Morton order (the bits of ti and tj
+/// interleaved) of the smallest power of two square that holds them all,
+/// skipping the positions outside the block.
+ ****************************************************************************/
+void tiledInit(struct Tiled *t, int rows, int columns, struct Arena *arena)
+{
+    int side, code, ti, tj, bit, k = 0;
+
+    t->rows = rows;
+    t->columns = columns;
+    t->tr = (rows + TILE-1) / TILE;
+    t->tc = (columns + TILE-1) / TILE;
+    t->order = (int *)arenaAlloc(arena, t->tr*t->tc*sizeof(int));
+    t->offset = (int *)arenaAlloc(arena, t->tr*t->tc*sizeof(int));
+
+    for (side = 1; side < t->tr || side < t->tc; side *= 2)
+        ;
+    for (code = 0; code < side*side; code++){
+        ti = tj = 0;
+        for (bit = 0; (1 << bit) < side; bit++){
+            ti |= ((code >> (2*bit+1)) & 1) << bit;
+            tj |= ((code >> (2*bit)) & 1) << bit;
+        }
+        if (ti < t->tr && tj < t->tc){
+            t->order[k] = ti*t->tc + tj;
+            t->offset[ti*t->tc + tj] = k*TILE*TILE;
+            k++;
+        }
+    }
+}
 
-    /* free the pointers into the memory */
-    free(*array);
+/**************************************************************************
+ *  subroutines tiledRow, tiledPack
+/// tiledRow copies row ix (1..rows) of the tiled block u to row (indexed
+/// 0..columns-1), or from it if store is set. tiledPack copies the edges of
+/// u to the contiguous buffers they are sent from: the first/last row to
+/// packup/packdown (indexed 1..columns), the first/last column to
+/// packleft/packright (indexed 1..rows).
+ ****************************************************************************/
+void tiledRow(const struct Tiled *t, float *u, int ix, float *row, int store)
+{
+    int tj, n, r = (ix-1) / TILE;
+    float *p;
+
+    for (tj = 0; tj < t->tc; tj++){
+        p = u + t->offset[r*t->tc + tj] + (ix-1)%TILE * TILE;
+        n = (tj < t->tc-1) ? TILE : t->columns - tj*TILE;
+        if (store)
+            memcpy(p, row + tj*TILE, n*sizeof(float));
+        else
+            memcpy(row + tj*TILE, p, n*sizeof(float));
+    }
+}
 
-    return 0;
+void tiledPack(const struct Tiled *t, const float *u, float *packup, float *packdown, float *packleft, float *packright)
+{
+    int ix;
+    const float *first, *last;
+
+    tiledRow(t, (float *)u, 1, packup+1, 0);
+    tiledRow(t, (float *)u, t->rows, packdown+1, 0);
+    for (ix = 1; ix <= t->rows; ix++){
+        first = u + t->offset[(ix-1)/TILE * t->tc] + (ix-1)%TILE * TILE;
+        last = u + t->offset[(ix-1)/TILE * t->tc + t->tc-1] + (ix-1)%TILE * TILE;
+        packleft[ix] = first[0];
+        packright[ix] = last[(t->columns-1)%TILE];
+    }
+}
+
+/**************************************************************************
+ *  subroutine arenaSize
+/// bytes of the arena of a rows x columns block kept in grids full grids
+/// (1 or 2) of the given layout: what main, malloc2darr, tiledInit
+/// and reducedInit take from it, each rounded up to whole cache lines
+ ****************************************************************************/
+size_t arenaSize(int rows, int columns, int grids, int layout, int precision)
+{
+    size_t size;
+    int ld = leadingDimension(columns+2), tiles = ((rows+TILE-1)/TILE) * ((columns+TILE-1)/TILE);
+
+    if (layout == TILED){
+        size = grids * LINES(tiles * TILE*TILE * sizeof(float) + 2*ALIGN);
+        size += 2 * LINES(tiles * sizeof(int));                              /* order, offset */
+        size += 4 * LINES((columns+2) * sizeof(float));                      /* packup, packdown */
+    }
+    else
+        size = grids * (LINES(((rows+2) * ld + ALIGN/sizeof(float)) * sizeof(float)) + LINES((rows+2) * sizeof(float*)));
+    size += 2 * LINES(ld * sizeof(float));                                   /* roll */
+    size += 4 * LINES((rows+2) * sizeof(float));                             /* packleft, packright */
+    size += LINES((2*(columns+2) + 2*(rows+2)) * sizeof(float));            /* halobuf */
+    if (precision != FP32){
+        size += 4 * (LINES(rows * sizeof(uint16_t)) + LINES(columns * sizeof(uint16_t)));   /* codes */
+        size += LINES((2*(columns+2) + 2*(rows+2)) * sizeof(float));        /* stage */
+        if (precision == DELTA)
+            size += 4 * (LINES(rows * sizeof(float)) + LINES(columns * sizeof(float)));     /* sent, got */
+    }
+    return size;
+}
+
+/**************************************************************************
+ *  subroutines arenaInit, arenaAlloc, arenaFree
+/// arenaInit allocates size bytes, 2MB aligned and advised to be backed by
+/// transparent huge pages if huge is set and size is at least 2MB. If bind
+/// is set the pages may only come from the NUMA node the task runs on.
+/// Every page is then touched, so the memory is really there (and, without
+/// bind, first touch puts it near the task). Returns 0 if it can't.
+/// arenaAlloc hands out zeroed, cache line aligned pieces of it.
+ ****************************************************************************/
+int arenaInit(struct Arena *a, size_t size, int huge, int bind)
+{
+    size_t align = (huge && size >= HUGEPAGE) ? HUGEPAGE : ALIGN;
+    void *base;
+
+    a->size = size;
+    a->used = 0;
+    if (posix_memalign(&base, align, size))
+        return 0;
+    a->base = (char *)base;
+#ifdef MADV_HUGEPAGE
+    if (align == HUGEPAGE)
+        madvise(base, size / HUGEPAGE * HUGEPAGE, MADV_HUGEPAGE);
+#endif
+    if (bind){
+        unsigned cpu, numanode;
+        unsigned long mask[16] = {0}, page = sysconf(_SC_PAGESIZE);     /* a bit per node, up to 1024 */
+        char *first = (char *)(((uintptr_t)base + page-1) / page * page);
+        const unsigned bits = 8*sizeof(mask[0]);
+
+        /* mbind works on whole pages, the ones the arena shares with the heap stay where they are */
+        syscall(SYS_getcpu, &cpu, &numanode, NULL);
+        if (numanode >= 16*bits)
+            printf("WARNING: can't bind the arena to NUMA node %u\n", numanode);
+        else{
+            mask[numanode/bits] = 1UL << (numanode%bits);
+            if (first < a->base + size && syscall(SYS_mbind, first, (a->base + size - first) / page * page,
+                                                   MPOL_BIND, mask, 16*bits, 0))
+                printf("WARNING: can't bind the arena to NUMA node %u\n", numanode);
+        }
+    }
+    memset(base, 0, size);
+    return 1;
+}
+
+void *arenaAlloc(struct Arena *a, size_t bytes)
+{
+    void *p = a->base + a->used;
+
+    if (a->used + LINES(bytes) > a->size){
+        printf("ERROR: the arena of %zu bytes is too small (arenaSize is missing a buffer)\n", a->size);
+        MPI_Abort(MPI_COMM_WORLD, 22);
+    }
+    a->used += LINES(bytes);
+    return p;
+}
+
+void arenaFree(struct Arena *a)
+{
+    free(a->base);
+}
+
+/**************************************************************************
+ *  halo exchange backends
+/// p2p:        Irecv/Isend every step
+/// persistent: Recv_init/Send_init once per domain, Startall every step
+/// neighbor:   one MPI_Ineighbor_alltoallw on the cartesian communicator
+/// rma:        MPI_Put into the neighbors' halo buffers between two fences
+/// shm:        memcpy into the neighbors' halo buffers, which live in a
+///             shared memory window; only when all tasks share one node
+ ****************************************************************************/
+void p2pStart(struct Exchange *ex, int iz)
+{
+    int s;
+    for (s=0; s<4; s++)
+        MPI_Irecv(ex->recv[s], ex->count[s], ex->type[s], ex->nb[s], 0, ex->comm, &ex->req[s]);
+    for (s=0; s<4; s++)
+        MPI_Isend(ex->send[iz][s], ex->count[s], ex->type[s], ex->nb[s], 0, ex->comm, &ex->req[4+s]);
+}
+
+void p2pFinish(struct Exchange *ex)
+{
+    MPI_Waitall(8, ex->req, MPI_STATUSES_IGNORE);
+}
+
+void p2pFree(struct Exchange *ex)
+{
+}
+
+void persistentStart(struct Exchange *ex, int iz)
+{
+    MPI_Startall(8, &ex->req[8*iz]);
+    ex->domain = iz;
+}
+
+void persistentFinish(struct Exchange *ex)
+{
+    MPI_Waitall(8, &ex->req[8*ex->domain], MPI_STATUSES_IGNORE);
+}
+
+void persistentFree(struct Exchange *ex)
+{
+    int i;
+    for (i=0; i<16; i++)
+        MPI_Request_free(&ex->req[i]);
+}
+
+void neighborStart(struct Exchange *ex, int iz)
+{
+    MPI_Ineighbor_alltoallw(MPI_BOTTOM, ex->count, ex->sdispl[iz], ex->type,
+                            MPI_BOTTOM, ex->count, ex->rdispl, ex->type, ex->comm, &ex->req[0]);
+}
+
+void neighborFinish(struct Exchange *ex)
+{
+    MPI_Wait(&ex->req[0], MPI_STATUS_IGNORE);
+}
+
+void rmaStart(struct Exchange *ex, int iz)
+{
+    int s;
+    /* the neighbors have read the halos of the previous step */
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, ex->win);
+    for (s=0; s<4; s++)
+        if (ex->nb[s] != MPI_PROC_NULL)
+            MPI_Put(ex->send[iz][s], ex->count[s], ex->type[s], ex->nb[s], ex->offset[s^1] + 1,
+                    ex->count[s], ex->type[s], ex->win);
+}
+
+void rmaFinish(struct Exchange *ex)
+{
+    MPI_Win_fence(MPI_MODE_NOSUCCEED, ex->win);
+}
+
+void winFree(struct Exchange *ex)
+{
+    MPI_Win_free(&ex->win);
+}
+
+void shmStart(struct Exchange *ex, int iz)
+{
+    int s;
+    /* the neighbors have read the halos of the previous step */
+    MPI_Barrier(ex->comm);
+    for (s=0; s<4; s++)
+        if (ex->nb[s] != MPI_PROC_NULL)
+            memcpy(ex->peer[s], ex->send[iz][s], ex->count[s]*ex->size);
+}
+
+void shmFinish(struct Exchange *ex)
+{
+    MPI_Win_sync(ex->win);
+    MPI_Barrier(ex->comm);
+    MPI_Win_sync(ex->win);
+}
+
+void shmFree(struct Exchange *ex)
+{
+    /* copy the last halos back, the buffers of main stay in use after the exchange is gone */
+    memcpy(ex->saved, ex->halo->up, (ex->offset[RIGHT] + ex->count[LEFT] + 2)*sizeof(float));
+    ex->halo->up = ex->saved;
+    ex->halo->down = ex->halo->up + ex->offset[DOWN];
+    ex->halo->left = ex->halo->up + ex->offset[LEFT];
+    ex->halo->right = ex->halo->up + ex->offset[RIGHT];
+    MPI_Win_unlock_all(ex->win);
+    MPI_Win_free(&ex->win);
+}
+
+/**************************************************************************
+ *  subroutine exchangeInit
+/// prepares ex to exchange the halos with backend. nb are the neighbor
+/// tasks by side, send[iz][s] the edge of domain iz for side s, and halo
+/// the contiguous halo buffers (up, down, left, right one after the other).
+/// Every point is one elem; the buffers are laid out in floats, so elem
+/// may not be larger than a float.
+/// Collective over comm. Returns 0 if the backend can't work here (shm on
+/// more than one node, rma without one-sided support); then ex is left empty.
+ ****************************************************************************/
+int exchangeInit(struct Exchange *ex, int backend, const int nb[4], int rows, int columns, MPI_Datatype elem,
+                 float *send[2][4], struct Halo *halo, MPI_Comm comm)
+{
+    int s, iz, everywhere, onenode;
+    MPI_Comm node;
+
+    ex->name = backendName[backend];
+    MPI_Type_size(elem, &ex->size);
+    ex->halo = halo;
+    ex->comm = comm;
+    ex->offset[UP] = 0;
+    ex->offset[DOWN] = columns+2;
+    ex->offset[LEFT] = 2*(columns+2);
+    ex->offset[RIGHT] = 2*(columns+2) + rows+2;
+    for (s=0; s<4; s++){
+        ex->nb[s] = nb[s];
+        ex->count[s] = (s == UP || s == DOWN) ? columns : rows;
+        ex->recv[s] = halo->up + ex->offset[s] + 1;
+        ex->type[s] = elem;
+        for (iz=0; iz<2; iz++)
+            ex->send[iz][s] = send[iz][s];
+    }
+
+    switch (backend){
+    case PERSISTENT_BACKEND:
+        for (iz=0; iz<2; iz++)
+            for (s=0; s<4; s++){
+                MPI_Recv_init(ex->recv[s], ex->count[s], elem, nb[s], 0, comm, &ex->req[8*iz+s]);
+                MPI_Send_init(send[iz][s], ex->count[s], elem, nb[s], 0, comm, &ex->req[8*iz+4+s]);
+            }
+        ex->start = persistentStart;
+        ex->finish = persistentFinish;
+        ex->free = persistentFree;
+        return 1;
+
+    case NEIGHBOR_BACKEND:
+        /* the neighbors of a 2D cartesian communicator come in the order up, down, left, right */
+        for (s=0; s<4; s++){
+            MPI_Get_address(ex->recv[s], &ex->rdispl[s]);
+            for (iz=0; iz<2; iz++)
+                MPI_Get_address(send[iz][s], &ex->sdispl[iz][s]);
+        }
+        ex->start = neighborStart;
+        ex->finish = neighborFinish;
+        ex->free = p2pFree;
+        return 1;
+
+    case RMA_BACKEND:
+        /* Some MPI installations have no one-sided support (e.x. Open MPI without a suitable transport) */
+        MPI_Comm_set_errhandler(comm, MPI_ERRORS_RETURN);
+        s = (MPI_Win_create(halo->up, (ex->offset[RIGHT] + rows+2)*sizeof(float), sizeof(float), MPI_INFO_NULL,
+                            comm, &ex->win) == MPI_SUCCESS);
+        MPI_Comm_set_errhandler(comm, MPI_ERRORS_ARE_FATAL);
+        MPI_Allreduce(&s, &everywhere, 1, MPI_INT, MPI_LAND, comm);
+        if (!everywhere)
+            return 0;
+        MPI_Win_fence(0, ex->win);
+        ex->start = rmaStart;
+        ex->finish = rmaFinish;
+        ex->free = winFree;
+        return 1;
+
+    case SHM_BACKEND:
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+        MPI_Comm_size(node, &s);
+        MPI_Comm_size(comm, &everywhere);
+        onenode = (s == everywhere);
+        if (!onenode){
+            MPI_Comm_free(&node);
+            return 0;
+        }
+        /* comm and node hold the same tasks in the same order (key 0 keeps it), so the ranks are the same */
+        float *base;
+        MPI_Aint size;
+        int unit;
+        MPI_Win_allocate_shared((ex->offset[RIGHT] + rows+2)*sizeof(float), sizeof(float), MPI_INFO_NULL, node, &base, &ex->win);
+        MPI_Comm_free(&node);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, ex->win);
+
+        /* the halo buffers move into the window; the current halos come along */
+        memcpy(base, halo->up, (ex->offset[RIGHT] + rows+2)*sizeof(float));
+        ex->saved = halo->up;
+        halo->up = base;
+        halo->down = base + ex->offset[DOWN];
+        halo->left = base + ex->offset[LEFT];
+        halo->right = base + ex->offset[RIGHT];
+        for (s=0; s<4; s++){
+            ex->recv[s] = base + ex->offset[s] + 1;
+            ex->peer[s] = NULL;
+            if (nb[s] != MPI_PROC_NULL){
+                MPI_Win_shared_query(ex->win, nb[s], &size, &unit, &ex->peer[s]);
+                ex->peer[s] += ex->offset[s^1] + 1;
+            }
+        }
+        MPI_Win_sync(ex->win);
+        MPI_Barrier(comm);
+        ex->start = shmStart;
+        ex->finish = shmFinish;
+        ex->free = shmFree;
+        return 1;
+
+    default:
+        ex->start = p2pStart;
+        ex->finish = p2pFinish;
+        ex->free = p2pFree;
+        return 1;
+    }
+}
+
+/**************************************************************************
+ *  subroutines toHalf, fromHalf, toShort, fromShort
+/// conversions of a float to a 16 bit code and back, rounding to nearest
+/// even. toHalf gives an IEEE half and saturates to its largest finite
+/// value. toShort keeps the sign, the exponent and bits mantissa bits of the
+/// float (bits = 7 is bfloat16).
+ ****************************************************************************/
+uint16_t toHalf(float f, int *saturated)
+{
+    uint32_t x, sign, mant, h, rem, half;
+    int exp;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (x >> 16) & 0x8000;
+    exp = (int)((x >> 23) & 0xff) - 127 + 15;
+    mant = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    if (exp <= 0){
+        /* subnormal half */
+        if (exp < -10)
+            return sign;
+        mant |= 0x800000;
+        h = mant >> (14 - exp);
+        rem = mant & ((1u << (14 - exp)) - 1);
+        half = 1u << (13 - exp);
+        if (rem > half || (rem == half && (h & 1)))
+            h++;
+        return sign | h;
+    }
+    h = ((uint32_t)exp << 10) | (mant >> 13);
+    rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+    if (h >= 0x7c00){
+        (*saturated)++;
+        h = 0x7bff;
+    }
+    return sign | h;
+}
+
+float fromHalf(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16, exp = (h >> 10) & 0x1f, mant = h & 0x3ff, x;
+    float f;
+
+    if (exp == 0){
+        f = ldexpf((float)mant, -24);
+        return sign ? -f : f;
+    }
+    if (exp == 31)
+        x = sign | 0x7f800000 | (mant << 13);
+    else
+        x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+uint16_t toShort(float f, int bits)
+{
+    uint32_t x;
+    int shift = 23 - bits;
+
+    memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7f800000) != 0x7f800000)
+        x += (1u << (shift - 1)) - 1 + ((x >> shift) & 1);
+    return (uint16_t)(x >> shift);
+}
+
+float fromShort(uint16_t code, int bits)
+{
+    uint32_t x = (uint32_t)code << (23 - bits);
+    float f;
+
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/**************************************************************************
+ *  subroutine reducedInit
+/// prepares q for the precision mode: the code buffers of the edges and of
+/// the halos, taken from arena. For DELTA both ends start from zero.
+ ****************************************************************************/
+void reducedInit(struct Reduced *q, int mode, int bits, int rows, int columns, float *edge[2][4], struct Halo *halo,
+                 struct Arena *arena)
+{
+    int s, iz, n;
+    float *stage;
+
+    memset(q, 0, sizeof(*q));
+    q->mode = mode;
+    q->bits = (mode == BF16) ? 7 : bits;
+    q->halo = halo;
+    if (mode == FP32)
+        return;
+
+    for (s=0; s<4; s++){
+        q->count[s] = (s == UP || s == DOWN) ? columns : rows;
+        for (iz=0; iz<2; iz++){
+            q->edge[iz][s] = edge[iz][s];
+            q->code[iz][s] = (float*)arenaAlloc(arena, q->count[s]*sizeof(uint16_t));
+        }
+        if (mode == DELTA){
+            q->sent[s] = (float*)arenaAlloc(arena, q->count[s]*sizeof(float));
+            q->got[s] = (float*)arenaAlloc(arena, q->count[s]*sizeof(float));
+        }
+    }
+
+    n = 2*(columns+2) + 2*(rows+2);
+    stage = (float*)arenaAlloc(arena, n*sizeof(float));
+    q->stage.up = stage;
+    q->stage.down = q->stage.up + columns+2;
+    q->stage.left = q->stage.down + columns+2;
+    q->stage.right = q->stage.left + rows+2;
+}
+
+/**************************************************************************
+ *  subroutines haloStart, haloFinish
+/// the exchange of a step with the precision of q: haloStart encodes the
+/// edges of domain iz and starts the exchange, haloFinish completes it and
+/// widens the received codes into the halo buffers
+ ****************************************************************************/
+void haloStart(struct Exchange *ex, struct Reduced *q, int iz)
+{
+    int s, i, saturated = 0;
+    uint16_t *code;
+    float value, err;
+
+    if (q->mode != FP32)
+        for (s=0; s<4; s++){
+            if (ex->nb[s] == MPI_PROC_NULL)
+                continue;
+            code = (uint16_t*)q->code[iz][s];
+            for (i=0; i<q->count[s]; i++){
+                value = q->edge[iz][s][i];
+                if (q->mode == FP16){
+                    code[i] = toHalf(value, &saturated);
+                    err = fabsf(value - fromHalf(code[i]));
+                }
+                else if (q->mode == BF16){
+                    code[i] = toShort(value, 7);
+                    err = fabsf(value - fromShort(code[i], 7));
+                }
+                else{
+                    /* the change since the last message; the neighbor adds it to what it has */
+                    code[i] = toShort(value - q->sent[s][i], q->bits);
+                    q->sent[s][i] += fromShort(code[i], q->bits);
+                    err = fabsf(value - q->sent[s][i]);
+                }
+                if (err > q->maxerr)
+                    q->maxerr = err;
+                q->sumerr += (double)err*err;
+            }
+            q->points += q->count[s];
+        }
+    q->saturated += saturated;
+    ex->start(ex, iz);
+}
+
+void haloFinish(struct Exchange *ex, struct Reduced *q)
+{
+    int s, i;
+    uint16_t *code;
+    float *halo[4] = {q->halo->up, q->halo->down, q->halo->left, q->halo->right},
+          *stage[4] = {q->stage.up, q->stage.down, q->stage.left, q->stage.right};
+
+    ex->finish(ex);
+    if (q->mode == FP32)
+        return;
+    for (s=0; s<4; s++){
+        if (ex->nb[s] == MPI_PROC_NULL)
+            continue;
+        code = (uint16_t*)(stage[s] + 1);
+        for (i=0; i<q->count[s]; i++){
+            if (q->mode == FP16)
+                halo[s][i+1] = fromHalf(code[i]);
+            else if (q->mode == BF16)
+                halo[s][i+1] = fromShort(code[i], 7);
+            else
+                halo[s][i+1] = (q->got[s][i] += fromShort(code[i], q->bits));
+        }
+    }
 }
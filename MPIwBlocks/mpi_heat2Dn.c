@@ -0,0 +1,631 @@
+/****************************************************************************
+ * FILE: mpi_heat2D.c
+ * DESCRIPTIONS:
+ *   HEAT2D Example - Parallelized C Version
+ *   This example is based on a simplified two-dimensional heat
+ *   equation domain decomposition.  The initial temperature is computed to be
+ *   high in the middle of the domain and zero at the boundaries.  The
+ *   boundaries are held at zero throughout the simulation.  During the
+ *   time-stepping, an array containing two domains is used; these domains
+ *   alternate between old data and new data.
+ *
+ *   In this version the grid is decomposed into more blocks than there are
+ *   processes (overdecomposition) and every process owns a few of them.
+ *   Halos between blocks of the same process are copied, the others are
+ *   exchanged with messages. At each time step a process updates its blocks
+ *   in the order their halos arrive, so while the halos of one block are
+ *   still on their way it works on another one.
+ *
+ *   Two data files are produced: an initial data set and a final data set.
+ * AUTHORS: Costas Pitharoulios, Simon Iyamu
+ *
+ ****************************************************************************/
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NXPROB      80                 /* x dimension of problem grid */
+#define NYPROB      64                 /* y dimension of problem grid */
+#define STEPS       100                /* number of time steps */
+#define BEGIN       2                  /* message tag */
+#define MASTER      0                  /* taskid of first process */
+#define BLOCKS      4                  /* default number of blocks per process */
+#define UP          0                  /* sides of a block */
+#define DOWN        1
+#define LEFT        2
+#define RIGHT       3
+#define ROWMAJOR    0                  /* orders of the blocks along which they are given to the tasks */
+#define MORTON      1
+#define HILBERT     2
+
+struct Parms {
+  float cx;
+  float cy;
+} parms = {0.1, 0.1};
+
+/* A block of the grid. The neighbor on side s sees this block on side s^1. */
+struct Block {
+  int id;                       /* position in the block grid, row-major */
+  int nb[4];                    /* neighbor blocks (UP, DOWN, LEFT, RIGHT), -1 on the boundary of the grid */
+  int owner[4];                 /* processes of the neighbor blocks */
+  float **u[2];                 /* the two domains, surrounded by halo points */
+  int missing;                  /* halos of the current step that haven't arrived yet */
+};
+
+void inidat(), prtdat(), updateRegion(), updateBlock(), copySide(), blockOrder(), cutReport();
+int malloc2darr(),free2darr(),checkSize(),curveOf();
+float *sideOf();
+long curveIndex();
+
+int main (int argc, char *argv[]){
+    struct Block *block;            /* the blocks of this task */
+    int	taskid,                     /* this task's unique id */
+        numworkers,                 /* number of worker processes */
+        dest, source,               /* to - from for message send-receive */
+        msgtype,                    /* for message types */
+        perrank=BLOCKS,             /* blocks per task */
+        curve=ROWMAJOR,             /* order of the blocks along which they are given to the tasks */
+        pernode=0,                  /* tasks per node for the edge cut report, 0 to ask MPI */
+        *order, *owner,             /* block of every position along the curve, task of every block */
+        nblocks,                    /* blocks of the whole grid */
+        xdim, ydim,                 /* dimensions of the block grid (e.x. 4x8) */
+        rows, columns,              /* number of rows/columns of each block (e.x. 20x8) */
+        nrecv, nsend,               /* halo messages of a step */
+        ready, done,                /* scheduler queue and number of updated blocks */
+        outcount,
+        b, s, n, i, x, iz, it;      /* loop variables */
+    double start,finish,
+           idle=0.0, t;             /* time spent waiting for halos with no block to update */
+    char inputfile[80] = "initial.dat";
+    char outputfile[80] = "final.dat";
+    MPI_Status status;
+
+    /* Read arguments */
+    for(i=1; i<argc; i++){
+        if(!strcmp(argv[i],"-i"))
+            strcpy(inputfile,argv[i+1]);
+        if(!strcmp(argv[i],"-o"))
+            strcpy(outputfile,argv[i+1]);
+        if(!strcmp(argv[i],"-b"))
+            perrank = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-m")){
+            curve = curveOf(argv[i+1]);
+            if (curve < 0){
+                printf("ERROR: unknown mapping %s (use rowmajor, morton or hilbert)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+        if(!strcmp(argv[i],"-N"))
+            pernode = strtol(argv[i+1], NULL, 10);
+    }
+    if (perrank <= 0){
+        printf("ERROR: wrong number of blocks per task!\n");
+        exit(22);
+    }
+
+    /* First, find out my taskid and how many tasks are running */
+    MPI_Init(&argc,&argv);
+    MPI_Comm_size(MPI_COMM_WORLD,&numworkers);
+    MPI_Comm_rank(MPI_COMM_WORLD,&taskid);
+    nblocks = numworkers*perrank;
+
+    if (taskid == MASTER) {
+        /************************* Master code *******************************/
+
+        if (!checkSize(inputfile)){
+            printf("ERROR: grid size of input file is diffrent that the definitions of NXPROB, NYPROB or file doesn't exist\n");
+            MPI_Abort(MPI_COMM_WORLD, 22);
+            exit(22);
+        }
+
+        printf ("Starting mpi_heat2D with %d worker tasks and %d blocks per task.\n", numworkers, perrank);
+        printf("Grid size: X= %d  Y= %d  Time steps= %d\n",NXPROB,NYPROB,STEPS);
+
+        /* Find the dimentions of the block grid, as square-like as the grid allows */
+        xdim = 0;
+        for (x=sqrt(nblocks) + 1; x>=1; x--){
+            if (nblocks % x == 0 && NXPROB % x == 0 && NYPROB % (nblocks/x) == 0){
+                xdim = x;
+                ydim = nblocks/x;
+                break;
+            }
+        }
+        for (x=sqrt(nblocks) + 1; !xdim && x<=nblocks; x++){
+            if (nblocks % x == 0 && NXPROB % x == 0 && NYPROB % (nblocks/x) == 0){
+                xdim = x;
+                ydim = nblocks/x;
+            }
+        }
+        if (!xdim){
+            printf("ERROR: the grid can't be split into %d equal blocks\n",nblocks);
+            MPI_Abort(MPI_COMM_WORLD, 22);
+            exit(22);
+        }
+
+        printf("The grid will part into a %d x %d block grid.\n",xdim,ydim);
+
+        /* Compute the length and height of each block */
+        rows = NXPROB / xdim;
+        columns = NYPROB / ydim;
+        printf("Each block is %d x %d.\n",rows,columns);
+
+        /*  Now send startup information to each worker  */
+        for (dest=1; dest<numworkers; dest++){
+            MPI_Send(&xdim, 1, MPI_INT, dest, BEGIN, MPI_COMM_WORLD);
+            MPI_Send(&ydim, 1, MPI_INT, dest, BEGIN, MPI_COMM_WORLD);
+            MPI_Send(&columns, 1, MPI_INT, dest, BEGIN, MPI_COMM_WORLD);
+            MPI_Send(&rows, 1, MPI_INT, dest, BEGIN, MPI_COMM_WORLD);
+        }
+    }else{
+        /* taskid != MASTER */
+
+        /* Receive the block grid from master */
+        source = MASTER; msgtype = BEGIN;
+        MPI_Recv(&xdim, 1, MPI_INT, source, msgtype, MPI_COMM_WORLD, &status);
+        MPI_Recv(&ydim, 1, MPI_INT, source, msgtype, MPI_COMM_WORLD, &status);
+        MPI_Recv(&columns, 1, MPI_INT, source, msgtype, MPI_COMM_WORLD, &status);
+        MPI_Recv(&rows, 1, MPI_INT, source, msgtype, MPI_COMM_WORLD, &status);
+    }
+
+    /* Tasks that share a node with this one, if they were not given */
+    if (pernode <= 0){
+        MPI_Comm node;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, taskid, MPI_INFO_NULL, &node);
+        MPI_Comm_size(node, &pernode);
+        MPI_Comm_free(&node);
+    }
+
+    /* Order the blocks along the curve. Task t owns positions t*perrank .. (t+1)*perrank-1,
+     * so with the row-major order it owns consecutive blocks of a row. */
+    order = (int*)malloc(nblocks*sizeof(int));
+    owner = (int*)malloc(nblocks*sizeof(int));
+    blockOrder(curve, xdim, ydim, order);
+    for (i=0; i<nblocks; i++)
+        owner[order[i]] = i / perrank;
+
+    if (taskid == MASTER)
+        cutReport(xdim, ydim, rows, columns, perrank, pernode, curve);
+
+    /* Find the neighbors of the blocks of this task and allocate them */
+    block = (struct Block*)malloc(perrank*sizeof(struct Block));
+    for (b=0; b<perrank; b++){
+        struct Block *B = &block[b];
+        B->id = order[taskid*perrank + b];
+        B->nb[UP] = (B->id < ydim) ? -1 : B->id - ydim;
+        B->nb[DOWN] = (B->id >= (xdim-1)*ydim) ? -1 : B->id + ydim;
+        B->nb[LEFT] = (B->id % ydim == 0) ? -1 : B->id - 1;
+        B->nb[RIGHT] = (B->id % ydim == ydim-1) ? -1 : B->id + 1;
+        for (s=0; s<4; s++)
+            B->owner[s] = (B->nb[s] < 0) ? MPI_PROC_NULL : owner[B->nb[s]];
+
+        for (iz=0; iz<2; iz++){
+            malloc2darr(&B->u[iz], rows+2, columns+2);
+            memset(&B->u[iz][0][0], 0, (rows+2)*(columns+2)*sizeof(float));
+        }
+    }
+
+    /* Preparing the datatypes for Parallel I/O */
+
+    /* Define the datatype of send buffer elements */
+    int sendsizes[2]    = {NXPROB, NYPROB};    /* grid size */
+    int sendsubsizes[2] = {rows, columns};     /* local size without halo */
+    int sendstarts[2]   = {0,0};
+
+    MPI_Datatype type, sendsubarrtype;
+    MPI_Type_create_subarray(2, sendsizes, sendsubsizes, sendstarts, MPI_ORDER_C, MPI_FLOAT, &type);
+    MPI_Type_create_resized(type, 0, columns*sizeof(float), &sendsubarrtype);
+    MPI_Type_commit(&sendsubarrtype);
+
+    /* Define the datatype of receive buffer elements */
+    int recvsizes[2]    = {rows+2, columns+2};         /* local array size */
+    int recvsubsizes[2] = {rows, columns};          /* local size without halo */
+    int recvstarts[2]   = {1,1};
+
+    MPI_Datatype recvsubarrtype;
+    MPI_Type_create_subarray(2, recvsizes, recvsubsizes, recvstarts, MPI_ORDER_C, MPI_FLOAT, &recvsubarrtype);
+    MPI_Type_commit(&recvsubarrtype);
+
+    /* Open file for reading. Every task sets the view of each of its blocks in turn; set_view is
+     * collective, but all tasks own the same number of blocks. */
+    MPI_File fh;
+    MPI_Offset disp;
+    MPI_File_open(MPI_COMM_WORLD, inputfile, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    for (b=0; b<perrank; b++){
+        disp = ((block[b].id/ydim)*rows*NYPROB + block[b].id%ydim*columns)*sizeof(float);
+        MPI_File_set_view(fh, disp, MPI_FLOAT, sendsubarrtype, "native", MPI_INFO_NULL);
+        MPI_File_read(fh, &(block[b].u[0][0][0]), 1, recvsubarrtype, &status);
+    }
+    MPI_File_close(&fh);
+
+    /* The rows of a side are contiguous, the columns are one float every row */
+    MPI_Datatype row, column, sidetype[4];
+    MPI_Type_contiguous(columns, MPI_FLOAT, &row);
+    MPI_Type_commit(&row);
+    MPI_Type_vector(rows, 1, columns+2, MPI_FLOAT, &column);
+    MPI_Type_commit(&column);
+    sidetype[UP] = sidetype[DOWN] = row;
+    sidetype[LEFT] = sidetype[RIGHT] = column;
+
+    /* Requests of the halo messages of a step and the block each receive belongs to */
+    MPI_Request *rreq = (MPI_Request*)malloc(4*perrank*sizeof(MPI_Request)),
+                *sreq = (MPI_Request*)malloc(4*perrank*sizeof(MPI_Request));
+    int *local = (int*)malloc(nblocks*sizeof(int)),    /* position of each block of this task in block */
+        *rblock = (int*)malloc(4*perrank*sizeof(int)),
+        *indices = (int*)malloc(4*perrank*sizeof(int)),
+        *queue = (int*)malloc(perrank*sizeof(int));
+    for (b=0; b<perrank; b++)
+        local[block[b].id] = b;
+
+    /// *** WORK STARTS HERE *** ///
+
+    /* Start the timer */
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+
+    iz = 0;
+    for (it = 1; it <= STEPS; it++){
+        nrecv = nsend = ready = done = 0;
+
+        /// *** RECEIVING PROCEDURES *** ///
+        /* Halos from blocks of this task are copied right away. The tag tells which block and side a message is for. */
+        for (b=0; b<perrank; b++){
+            block[b].missing = 0;
+            for (s=0; s<4; s++){
+                n = block[b].nb[s];
+                if (n < 0)
+                    continue;
+                if (block[b].owner[s] == taskid)
+                    copySide(&block[local[n]], &block[b], s, iz, rows, columns);
+                else{
+                    MPI_Irecv(sideOf(&block[b], iz, s, 1, rows, columns), 1, sidetype[s], block[b].owner[s],
+                              block[b].id*4 + s, MPI_COMM_WORLD, &rreq[nrecv]);
+                    rblock[nrecv++] = b;
+                    block[b].missing++;
+                }
+            }
+            if (!block[b].missing)
+                queue[ready++] = b;
+        }
+
+        /// *** SENDING PROCEDURES *** ///
+        for (b=0; b<perrank; b++)
+            for (s=0; s<4; s++)
+                if (block[b].nb[s] >= 0 && block[b].owner[s] != taskid)
+                    MPI_Isend(sideOf(&block[b], iz, s, 0, rows, columns), 1, sidetype[s], block[b].owner[s],
+                              block[b].nb[s]*4 + (s^1), MPI_COMM_WORLD, &sreq[nsend++]);
+
+        /// *** CALCULATION *** ///
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        // Block scheduler: a block is updated as soon as all of its halos are there. Between two blocks the arrived
+        // messages are collected with Testsome; only when no block is ready we block in Waitsome.
+        //----------------------------------------------------------------------------------------------------------------------------------------------
+        while (done < perrank){
+            if (ready){
+                updateBlock(&block[queue[--ready]], iz, rows, columns);
+                done++;
+                if (nrecv)
+                    MPI_Testsome(nrecv, rreq, &outcount, indices, MPI_STATUSES_IGNORE);
+                else
+                    outcount = 0;
+            }
+            else{
+                t = MPI_Wtime();
+                MPI_Waitsome(nrecv, rreq, &outcount, indices, MPI_STATUSES_IGNORE);
+                idle += MPI_Wtime() - t;
+            }
+            for (i=0; i<outcount && outcount != MPI_UNDEFINED; i++)
+                if (--block[rblock[indices[i]]].missing == 0)
+                    queue[ready++] = rblock[indices[i]];
+        }
+
+        MPI_Waitall(nsend, sreq, MPI_STATUSES_IGNORE);
+        iz = 1-iz;
+    }
+
+    /// *** WORK COMPLETE *** ///
+
+    /* Stop the timer */
+    finish = MPI_Wtime();
+
+    /* Each worker writes its blocks to their portions of the file */
+    MPI_File_open(MPI_COMM_WORLD, outputfile, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    for (b=0; b<perrank; b++){
+        disp = ((block[b].id/ydim)*rows*NYPROB + block[b].id%ydim*columns)*sizeof(float);
+        MPI_File_set_view(fh, disp, MPI_FLOAT, sendsubarrtype, "native", MPI_INFO_NULL);
+        MPI_File_write(fh, &(block[b].u[iz][0][0]), 1, recvsubarrtype, &status);
+    }
+    MPI_File_close(&fh);
+
+    printf("Process:%d, Elapsed time: %e secs\n",taskid,finish-start);
+    printf("Process:%d, Blocks: %d, idle waiting for halos: %e secs\n",taskid,perrank,idle);
+
+    /* Free malloc'd memory */
+    for (b=0; b<perrank; b++){
+        free2darr(&block[b].u[0]);
+        free2darr(&block[b].u[1]);
+    }
+    free(block);
+    free(order);
+    free(owner);
+    free(local);
+    free(rreq);
+    free(sreq);
+    free(rblock);
+    free(indices);
+    free(queue);
+
+    MPI_Type_free(&type);
+    MPI_Type_free(&sendsubarrtype);
+    MPI_Type_free(&recvsubarrtype);
+    MPI_Type_free(&row);
+    MPI_Type_free(&column);
+
+    MPI_Finalize();
+    return 0;
+}
+
+/* Returns the block order with the given name or -1 if there is no such order */
+int curveOf(const char *name){
+    if (!strcmp(name,"rowmajor"))
+        return ROWMAJOR;
+    if (!strcmp(name,"morton"))
+        return MORTON;
+    if (!strcmp(name,"hilbert"))
+        return HILBERT;
+    return -1;
+}
+
+/**************************************************************************
+ *  subroutine curveIndex
+/// position of point (x,y) along the curve that fills an n x n square,
+/// n a power of 2
+ ****************************************************************************/
+long curveIndex(int curve, int n, int x, int y)
+{
+    long d = 0;
+    int s, rx, ry, t;
+
+    for (s=n/2; s>0; s/=2){
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        if (curve == MORTON){
+            d += (long)s*s*(2*rx + ry);
+            continue;
+        }
+        d += (long)s*s*((3*rx) ^ ry);
+        /* rotate the quadrant, so the curve of the next level continues where this one stopped */
+        if (ry == 0){
+            if (rx == 1){
+                x = n-1 - x;
+                y = n-1 - y;
+            }
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+/* Key of a block along the curve, for qsort */
+struct CurveKey {
+    long d;
+    int id;
+};
+
+int compareKeys(const void *a, const void *b){
+    long da = ((const struct CurveKey*)a)->d, db = ((const struct CurveKey*)b)->d;
+    return (da > db) - (da < db);
+}
+
+/**************************************************************************
+ *  subroutine blockOrder
+/// gives the blocks of the xdim x ydim block grid in the order of curve.
+/// Grids that are not a power of 2 square are placed in the smallest one
+/// that contains them, and the curve skips the positions outside the grid.
+ ****************************************************************************/
+void blockOrder(int curve, int xdim, int ydim, int *order)
+{
+    int n = 1, i;
+    struct CurveKey *key = (struct CurveKey*)malloc(xdim*ydim*sizeof(struct CurveKey));
+
+    while (n < xdim || n < ydim)
+        n *= 2;
+    for (i=0; i<xdim*ydim; i++){
+        key[i].id = i;
+        key[i].d = (curve == ROWMAJOR) ? i : curveIndex(curve, n, i/ydim, i%ydim);
+    }
+    qsort(key, xdim*ydim, sizeof(struct CurveKey), compareKeys);
+    for (i=0; i<xdim*ydim; i++)
+        order[i] = key[i].id;
+    free(key);
+}
+
+/**************************************************************************
+ *  subroutine cutReport
+/// prints, for every block order, how many halo points per step cross
+/// between tasks and between nodes, when task t is on node t/pernode
+ ****************************************************************************/
+void cutReport(int xdim, int ydim, int rows, int columns, int perrank, int pernode, int chosen)
+{
+    const char *names[3] = {"rowmajor", "morton", "hilbert"};
+    int nblocks = xdim*ydim,
+        *order = (int*)malloc(nblocks*sizeof(int)),
+        *owner = (int*)malloc(nblocks*sizeof(int)),
+        curve, i, a, b;
+    long taskcut, nodecut;
+
+    printf("Halo points per step that cross tasks / nodes (%d tasks per node):\n", pernode);
+    for (curve=ROWMAJOR; curve<=HILBERT; curve++){
+        blockOrder(curve, xdim, ydim, order);
+        for (i=0; i<nblocks; i++)
+            owner[order[i]] = i / perrank;
+
+        /* every edge between two blocks once, both ways */
+        taskcut = nodecut = 0;
+        for (a=0; a<nblocks; a++){
+            if (a % ydim != ydim-1){
+                b = a+1;
+                taskcut += 2*rows*(owner[a] != owner[b]);
+                nodecut += 2*rows*(owner[a]/pernode != owner[b]/pernode);
+            }
+            if (a < (xdim-1)*ydim){
+                b = a+ydim;
+                taskcut += 2*columns*(owner[a] != owner[b]);
+                nodecut += 2*columns*(owner[a]/pernode != owner[b]/pernode);
+            }
+        }
+        printf("  %-8s %8ld / %8ld%s\n", names[curve], taskcut, nodecut, curve == chosen ? "   <- used" : "");
+    }
+    free(order);
+    free(owner);
+}
+
+/**************************************************************************
+ *  subroutine sideOf
+/// gives the first point of side s of domain iz of block B: of its edge if
+/// halo is 0, or of the halo points next to it if halo is 1
+ ****************************************************************************/
+float *sideOf(struct Block *B, int iz, int s, int halo, int rows, int columns)
+{
+    switch (s){
+    case UP:
+        return &B->u[iz][halo ? 0 : 1][1];
+    case DOWN:
+        return &B->u[iz][halo ? rows+1 : rows][1];
+    case LEFT:
+        return &B->u[iz][1][halo ? 0 : 1];
+    default:
+        return &B->u[iz][1][halo ? columns+1 : columns];
+    }
+}
+
+/**************************************************************************
+ *  subroutine copySide
+/// copies the edge of block from, which is on side s of block to, into the
+/// halo points of side s of to
+ ****************************************************************************/
+void copySide(struct Block *from, struct Block *to, int s, int iz, int rows, int columns)
+{
+    int i;
+    float *src = sideOf(from, iz, s^1, 0, rows, columns),
+          *dst = sideOf(to, iz, s, 1, rows, columns);
+
+    if (s == UP || s == DOWN)
+        memcpy(dst, src, columns*sizeof(float));
+    else
+        for (i=0; i<rows; i++)
+            dst[i*(columns+2)] = src[i*(columns+2)];
+}
+
+/**************************************************************************
+ *  subroutine updateBlock
+/// updates the whole block B from domain iz to 1-iz. Rows and columns
+/// without a neighbor are the boundary of the whole grid, so they are not
+/// calculated.
+ ****************************************************************************/
+void updateBlock(struct Block *B, int iz, int rows, int columns)
+{
+    updateRegion(B->nb[UP] < 0 ? 2 : 1, B->nb[DOWN] < 0 ? rows-1 : rows,
+                 B->nb[LEFT] < 0 ? 2 : 1, B->nb[RIGHT] < 0 ? columns-1 : columns,
+                 columns, &B->u[iz][0][0], &B->u[1-iz][0][0]);
+}
+
+/**************************************************************************
+ *  subroutine updateRegion
+/// updates the rectangle [x0,x1] x [y0,y1] (inclusive). ny = number of block
+/// columns without the two which keep LEFT AND RIGHT neighbors' values
+ ****************************************************************************/
+void updateRegion(int x0, int x1, int y0, int y1, int ny, float *u1, float *u2)
+{
+   int ix, iy;
+   for (ix = x0; ix <= x1; ix++){
+      for (iy = y0; iy <= y1; iy++){
+         *(u2+ix*(ny+2)+iy) = *(u1+ix*(ny+2)+iy)  +
+                          parms.cx * (*(u1+(ix+1)*(ny+2)+iy) +
+                          *(u1+(ix-1)*(ny+2)+iy) -
+                          2.0 * *(u1+ix*(ny+2)+iy)) +
+                          parms.cy * (*(u1+ix*(ny+2)+iy+1) +
+                         *(u1+ix*(ny+2)+iy-1) -
+                          2.0 * *(u1+ix*(ny+2)+iy));
+       }
+    }
+}
+
+
+/*****************************************************************************
+ *  subroutine inidat
+ *****************************************************************************/
+void inidat(int nx, int ny, float *u) {
+int ix, iy;
+
+for (ix = 0; ix <= nx-1; ix++)
+  for (iy = 0; iy <= ny-1; iy++)
+     *(u+ix*ny+iy) = (float)(ix * (nx - ix - 1) * iy * (ny - iy - 1));
+}
+
+/**************************************************************************
+ * subroutine prtdat
+ **************************************************************************/
+void prtdat(int nx, int ny, float *u1, char *fnam) {
+int ix, iy;
+FILE *fp;
+
+fp = fopen(fnam, "w");
+for (iy = ny-1; iy >= 0; iy--) {
+  for (ix = 0; ix <= nx-1; ix++) {
+    fprintf(fp, "%6.1f", *(u1+ix*ny+iy));
+    if (ix != nx-1)
+      fprintf(fp, " ");
+    else
+      fprintf(fp, "\n");
+    }
+  }
+fclose(fp);
+}
+
+/* Checks if grid size of given file is the same as NXPROB x NYPROB */
+int checkSize(const char *filename){
+    FILE *fp;
+    fp = fopen(filename, "rb");
+    if(!fp)
+        return 0;
+    fseek(fp, 0L, SEEK_END);
+    long int sz = ftell(fp);
+    fclose(fp);
+
+    return sz == NYPROB*NXPROB*sizeof(float);
+}
+
+int malloc2darr(float ***array, int n, int m) {
+
+    /* allocate the n*m contiguous items */
+    float *p = (float *)malloc(n*m*sizeof(float));
+    if (!p) return -1;
+
+    /* allocate the row pointers into the memory */
+    (*array) = (float **)malloc(n*sizeof(float*));
+    if (!(*array)) {
+        free(p);
+        return -1;
+    }
+
+    /* set up the pointers into the contiguous memory */
+    for (int i=0; i<n; i++)
+        (*array)[i] = &(p[i*m]);
+
+    return 0;
+}
+
+int free2darr(float ***array) {
+    /* free the memory - the first element of the array is at the start */
+    free(&((*array)[0][0]));
+
+    /* free the pointers into the memory */
+    free(*array);
+
+    return 0;
+}
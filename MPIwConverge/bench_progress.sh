@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compares how the halos progress while updateInternal runs: only inside our
+# own MPI calls (-a none), with MPI_Testall every few rows (-a none -r rows),
+# with a progress thread per process (-a thread) or with the asynchronous
+# progress of the MPI library (-a library, MPICH only). Prints the slowest
+# process time and the mean overlapped share of the halo transfer of every run
+# (unknown for -a none and -a library, which can't see when the halos arrive).
+# usage: ./bench_progress.sh [tasks] [poll rows] [repetitions] [input file]
+
+TASKS=${1:-4}
+POLL=${2:-4}
+REPS=${3:-5}
+INPUT=${4:-../initial.dat}
+
+make -s mpi_heat2Dn || exit 1
+
+for mode in "none" "none -r $POLL" "thread" "library"; do
+    for rep in $(seq $REPS); do
+        mpirun -n $TASKS ./mpi_heat2Dn -a $mode -i $INPUT -o bench.dat |
+            awk -v m="$mode" '/Elapsed time/ { if ($4+0 > max) max = $4+0 }
+                              /Halo transfer/ && $6 ~ /%$/ { sum += $6+0; n++ }
+                              END { if (n) printf "%-12s %e secs, %5.1f%% overlapped\n", m, max, sum/n
+                                    else   printf "%-12s %e secs, overlap unknown\n", m, max }'
+    done
+done
+rm -f bench.dat
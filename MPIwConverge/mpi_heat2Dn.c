@@ -27,6 +27,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 
 #define NXPROB      80                 /* x dimension of problem grid */
 #define NYPROB      64               /* y dimension of problem grid */
@@ -37,14 +41,39 @@
 #define NONE        0                  /* indicates no neighbor */
 #define DONE        4                  /* message tag */
 #define MASTER      0                  /* taskid of first process */
+#define NONE_PROGRESS    0             /* halos progress only inside our MPI calls (and -r polling) */
+#define THREAD_PROGRESS  1             /* a progress thread completes the halo requests */
+#define LIBRARY_PROGRESS 2             /* ask the MPI library for its own asynchronous progress */
 
 struct Parms { 
   float cx;
   float cy;
 } parms = {0.1, 0.1};
 
-void inidat(), prtdat(), updateExternal(), updateInternal(),  myprint(), DUMMYDUMDUM();
-int malloc2darr(),free2darr(),isPrime(), isIdentical(),checkSize();
+/* Handed over to the progress thread. The compute thread posts the requests of a step and
+ * stores the step; from then on only the progress thread touches them until sent reaches it. */
+struct Progress {
+    MPI_Request *req;           /* halo requests of the step: 4 receives, then 4 sends */
+    MPI_Status *stat;           /* statuses of the receives */
+    atomic_int step;            /* step whose requests were handed over, -1 to stop the thread */
+    atomic_int received;        /* last step whose receives completed */
+    atomic_int sent;            /* last step whose sends completed */
+    double arrived;             /* time the receives of the last step completed */
+};
+
+/* Active tiles (-t). The block is cut in size x size tiles and every tile remembers the largest change
+ * it made in a step. A tile is updated only if it or one of the four tiles around it (or the halo next
+ * to it) moved more than the tolerance in the previous step; otherwise its new values are its old ones. */
+struct Tiles {
+    int size, nr, nc;           /* tile edge, tiles down and across the block */
+    float *last, *now;          /* largest change of each tile in the previous and in this step */
+    long points, skipped;       /* points due for an update, and those skipped */
+};
+
+void inidat(), prtdat(), updateExternal(), updateInternal(),  myprint(), DUMMYDUMDUM(), waitFor(), *progressLoop(), copyEdge(),
+     tilesInit(), tilesFree(), updateTiles(), readFrame(), cone();
+int malloc2darr(),free2darr(),isPrime(), isIdentical(),checkSize(), edgeChanged(), checkSnapshots(), rerun();
+float edgeDistance(), updateRegion();
 
 int main (int argc, char *argv[]){
     float u[NXPROB][NYPROB],        /* array for grid */
@@ -56,10 +85,24 @@ int main (int argc, char *argv[]){
         msgtype,                    /* for message types */
         xdim, ydim,                 /* dimensions of grid partition (e.x. 4x4) */
         rows, columns,              /* number of rows/columns of each block (e.x. 20x12) */
+        poll=0,                     /* rows of updateInternal between two MPI_Testall, 0 for no polling */
+        progress=NONE_PROGRESS,     /* who moves the halos while we compute updateInternal */
+        provided,                   /* thread support given by MPI */
+        count,                      /* points of a received halo */
+        tile=0,                     /* edge of the active tiles, 0 to update the whole block every step */
+        steps=STEPS,                /* steps of the main loop, 0 when an incremental rerun did them */
+        edges_sent=0, edges_skipped=0,      /* halo sends with and without data (-c) */
+        unseen=0,                   /* steps whose halos were not seen arriving before the end of updateInternal */
         i,j,x,y,ix,iy,iz,it;        /* loop variables */
-    double start,finish;
+    double start,finish,
+           posted, arrived, internal_done,     /* times of the current step */
+           transfer=0.0, overlapped=0.0,       /* halo transfer time and the part of it hidden behind updateInternal */
+           tolerance=-1.0;                     /* an edge is sent only if it moved more than this since its last send, <0 always */
     char inputfile[80] = "initial.dat";
     char outputfile[80] = "final.dat";
+    char snapfile[80] = "";         /* where to save the grid of every step (-S) */
+    char rerunfile[80] = "";        /* the snapshots of the baseline run an incremental rerun starts from (-R) */
+    long computed = 0;              /* point updates of an incremental rerun */
     MPI_Status status;
 
     /* Read arguments */
@@ -68,12 +111,59 @@ int main (int argc, char *argv[]){
             strcpy(inputfile,argv[i+1]);
         if(!strcmp(argv[i],"-o"))
             strcpy(outputfile,argv[i+1]);
+        if(!strcmp(argv[i],"-r"))
+            poll = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-c"))
+            tolerance = strtod(argv[i+1], NULL);
+        if(!strcmp(argv[i],"-t"))
+            tile = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-S"))
+            strcpy(snapfile,argv[i+1]);
+        if(!strcmp(argv[i],"-R"))
+            strcpy(rerunfile,argv[i+1]);
+        if(!strcmp(argv[i],"-a")){
+            if(!strcmp(argv[i+1],"none"))
+                progress = NONE_PROGRESS;
+            else if(!strcmp(argv[i+1],"thread"))
+                progress = THREAD_PROGRESS;
+            else if(!strcmp(argv[i+1],"library"))
+                progress = LIBRARY_PROGRESS;
+            else{
+                printf("ERROR: unknown progress mode %s (none, thread or library)\n",argv[i+1]);
+                exit(22);
+            }
+        }
+    }
+    if (poll < 0){
+        printf("ERROR: wrong polling interval!\n");
+        exit(22);
+    }
+    if (tile < 0){
+        printf("ERROR: wrong tile size!\n");
+        exit(22);
+    }
+
+    /* MPICH and its derivatives start their own progress thread when these are set before MPI_Init.
+     * Open MPI ignores them, so there this mode behaves like -a none. */
+    if (progress == LIBRARY_PROGRESS){
+        setenv("MPIR_CVAR_ASYNC_PROGRESS", "1", 0);
+        setenv("MPICH_ASYNC_PROGRESS", "1", 0);
     }
 
     /* First, find out my taskid and how many tasks are running */
-    MPI_Init(&argc,&argv);
+    MPI_Init_thread(&argc,&argv, progress == NONE_PROGRESS ? MPI_THREAD_SINGLE : MPI_THREAD_MULTIPLE, &provided);
     MPI_Comm_size(MPI_COMM_WORLD,&numworkers);
     MPI_Comm_rank(MPI_COMM_WORLD,&taskid);
+
+    /* Both threads call MPI in thread mode, which needs MPI_THREAD_MULTIPLE */
+    if (progress == THREAD_PROGRESS && provided < MPI_THREAD_MULTIPLE){
+        if (taskid == MASTER)
+            printf("WARNING: MPI_THREAD_MULTIPLE is not supported, falling back to -a none\n");
+        progress = NONE_PROGRESS;
+    }
+    /* Polling would complete requests the progress thread owns */
+    if (progress == THREAD_PROGRESS)
+        poll = 0;
     numworkers;
 
     if (taskid == MASTER) {
@@ -99,6 +189,12 @@ int main (int argc, char *argv[]){
             exit(22);
         }
 
+        if (rerunfile[0] && !checkSnapshots(rerunfile)){
+            printf("ERROR: %s doesn't hold the %d steps of a run with -S and this NXPROB, NYPROB\n", rerunfile, STEPS);
+            MPI_Abort(MPI_COMM_WORLD, 22);
+            exit(22);
+        }
+
         printf ("Starting mpi_heat2D with %d worker tasks.\n", numworkers);
 
 
@@ -259,8 +355,9 @@ int main (int argc, char *argv[]){
 
     iz = 0;
 
-    MPI_Request RRequestR, RRequestL, RRequestU, RRequestD;
-    MPI_Request SRequestR, SRequestL, SRequestU, SRequestD;
+    /* Halo requests of a step: receives from left, right, down, up, then sends to right, left, up, down */
+    MPI_Request hreq[8];
+    MPI_Status hstat[4];
 
     /* Datatypes for matrix column */
     MPI_Datatype column; 
@@ -286,35 +383,179 @@ int main (int argc, char *argv[]){
     MPI_Startall(16,req);
     MPI_Waitall(16,req,MPI_STATUS_IGNORE);
 
+    //----------------------------------------------------------------------------------------------------------------------------------------------
+    // Change-aware exchange (-c). Near steady state the edges hardly move, so an edge is sent only when some point of it
+    // moved more than tolerance since the last time we sent it. Otherwise we send an empty message, which tells the
+    // neighbor to keep the halo it has: it finds it in the other local array, where it received (or kept) it last step.
+    // lastsent holds what the neighbors have, in the order of the sends: right, left, up, down.
+    //----------------------------------------------------------------------------------------------------------------------------------------------
+    int sendto[4] = {right, left, up, down},
+        recvfrom[4] = {left, right, down, up},
+        points[4] = {rows, rows, columns, columns},             /* points of the edges, by send or receive */
+        stride[4] = {columns+2, columns+2, 1, 1},
+        changed[4] = {1, 1, 1, 1};
+    float *lastsent[4];
+    for (i=0; i<4; i++)
+        lastsent[i] = (float*)malloc(points[i]*sizeof(float));
+
+    /* Active tiles (-t) skip updates that change nothing beyond the -c tolerance (0 without -c).
+     * halomove holds how much each halo moved in this step, in the order of the receives. */
+    struct Tiles tiles;
+    float halomove[4];
+    if (tile > 0)
+        tilesInit(&tiles, tile, rows, columns);
+
+    struct Progress prog;
+    pthread_t progress_thread;
+    if (progress == THREAD_PROGRESS){
+        prog.req = hreq;
+        prog.stat = hstat;
+        atomic_init(&prog.step, 0);
+        atomic_init(&prog.received, 0);
+        atomic_init(&prog.sent, 0);
+        pthread_create(&progress_thread, NULL, progressLoop, &prog);
+    }
+
     iz = 0;
 
-    for (it = 1; it <= STEPS; it++){
+    //----------------------------------------------------------------------------------------------------------------------------------------------
+    // Snapshots (-S) keep the grid of every step, one frame after the other; frame 0 is the input. A later run with a
+    // slightly different input can start from them (-R): rerun does all the steps, and the main loop below none.
+    //----------------------------------------------------------------------------------------------------------------------------------------------
+    MPI_File snap;
+    if (snapfile[0]){
+        MPI_File_open(MPI_COMM_WORLD, snapfile, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &snap);
+        MPI_File_set_view(snap, disp, MPI_FLOAT, sendsubarrtype, "native", MPI_INFO_NULL);
+        MPI_File_write_all(snap, &(local[0][0][0]), 1, recvsubarrtype, &status);
+    }
+    if (rerunfile[0]){
+        iz = rerun(rerunfile, local, rows, columns, (taskid/ydim)*rows, taskid%ydim*columns, req, &computed);
+        steps = 0;
+    }
+
+    for (it = 1; it <= steps; it++){
 
         /// *** RECEIVING PROCEDURES *** ///
-        MPI_Irecv(&(local[iz][1][0]), 1, column, left, 0, comm_cart, &RRequestL); ///WARNING: 0??
-        MPI_Irecv(&(local[iz][1][columns+1]), 1, column, right, 0, comm_cart, &RRequestR); ///WARNING: 0?
-        MPI_Irecv(&(local[iz][rows+1][1]), columns, MPI_FLOAT, down, 0, comm_cart, &RRequestD); ///WARNING: 0??
-        MPI_Irecv(&(local[iz][0][1]), columns, MPI_FLOAT, up,0, comm_cart, &RRequestU); ///WARNING: 0??
+        MPI_Irecv(&(local[iz][1][0]), 1, column, left, 0, comm_cart, &hreq[0]); ///WARNING: 0??
+        MPI_Irecv(&(local[iz][1][columns+1]), 1, column, right, 0, comm_cart, &hreq[1]); ///WARNING: 0?
+        MPI_Irecv(&(local[iz][rows+1][1]), columns, MPI_FLOAT, down, 0, comm_cart, &hreq[2]); ///WARNING: 0??
+        MPI_Irecv(&(local[iz][0][1]), columns, MPI_FLOAT, up,0, comm_cart, &hreq[3]); ///WARNING: 0??
 
         /// *** SENDING PROCEDURES *** ///
-        MPI_Isend(&(local[iz][1][columns]), 1, column, right, 0, comm_cart, &SRequestR);  //sends column to RIGHT neighbor
-        MPI_Isend(&(local[iz][1][1]), 1, column, left , 0, comm_cart, &SRequestL);	//sends column to left neighbor
-        MPI_Isend(&(local[iz][1][1]), columns, MPI_FLOAT, up, 0, comm_cart, &SRequestU);  //sends to UP neighbor
-        MPI_Isend(&(local[iz][rows][1]), columns, MPI_FLOAT, down ,0, comm_cart, &SRequestD); //sends to DOWN neighbor
+        if (tolerance >= 0.0){
+            float *edge[4] = {&local[iz][1][columns], &local[iz][1][1], &local[iz][1][1], &local[iz][rows][1]};
+            for (i=0; i<4; i++){
+                if (sendto[i] == MPI_PROC_NULL)
+                    continue;
+                /* the first step sends everything: the halos of local[1] from the start are not the edges of local[0] */
+                changed[i] = edgeChanged(edge[i], stride[i], lastsent[i], points[i], it == 1 ? -1.0 : tolerance);
+                if (changed[i])
+                    edges_sent++;
+                else
+                    edges_skipped++;
+            }
+        }
+        MPI_Isend(&(local[iz][1][columns]), changed[0], column, right, 0, comm_cart, &hreq[4]);  //sends column to RIGHT neighbor
+        MPI_Isend(&(local[iz][1][1]), changed[1], column, left , 0, comm_cart, &hreq[5]);	//sends column to left neighbor
+        MPI_Isend(&(local[iz][1][1]), changed[2]*columns, MPI_FLOAT, up, 0, comm_cart, &hreq[6]);  //sends to UP neighbor
+        MPI_Isend(&(local[iz][rows][1]), changed[3]*columns, MPI_FLOAT, down ,0, comm_cart, &hreq[7]); //sends to DOWN neighbor
+        posted = MPI_Wtime();
+        arrived = 0.0;
+        if (progress == THREAD_PROGRESS)
+            atomic_store_explicit(&prog.step, it, memory_order_release);
 
         /// *** CALCULATION OF INTERNAL DATA *** ///
-        updateInternal(2, rows-1, columns,&local[iz][0][0], &local[1-iz][0][0]); // 2 and xdim-3 because we want to calculate only internal nodes of the block.
+        // 2 and xdim-3 because we want to calculate only internal nodes of the block.
         //line 0 contains neighbor's values and line 1 is the extrnal line of the block, so we don't want them. The same for the one before last and the last line.
+        if (tile > 0)
+            updateTiles(&tiles, 0, NULL, tolerance > 0.0 ? tolerance : 0.0, rows, columns, right, left, up, down,
+                        &local[iz][0][0], &local[1-iz][0][0]);
+        else if (poll == 0)
+            updateInternal(2, rows-1, columns,&local[iz][0][0], &local[1-iz][0][0]);
+        else{
+            /* Many MPI libraries only move messages inside MPI calls, so every poll rows we call MPI_Testall
+             * on the halo requests. It also tells us when the halos arrived. */
+            int flag;
+            for (ix = 2; ix <= rows-1; ix += poll){
+                updateInternal(ix, (ix+poll-1 < rows-1) ? ix+poll-1 : rows-1, columns,&local[iz][0][0], &local[1-iz][0][0]);
+                if (arrived == 0.0){
+                    MPI_Testall(4, hreq, &flag, hstat);
+                    if (flag)
+                        arrived = MPI_Wtime();
+                }
+            }
+        }
+        internal_done = MPI_Wtime();
 
-        if (right != MPI_PROC_NULL) MPI_Wait(&RRequestR , MPI_STATUS_IGNORE );
-        if (left != MPI_PROC_NULL) MPI_Wait(&RRequestL , MPI_STATUS_IGNORE );
-        if (up !=  MPI_PROC_NULL) MPI_Wait(&RRequestU , MPI_STATUS_IGNORE );
-        if (down !=  MPI_PROC_NULL) MPI_Wait(&RRequestD , MPI_STATUS_IGNORE );
+        if (progress == THREAD_PROGRESS){
+            waitFor(&prog.received, it);
+            arrived = prog.arrived;
+        }
+        else if (arrived == 0.0)
+            MPI_Waitall(4, hreq, hstat);
+
+        /* Overlap is only credited when we saw when the halos arrived: the progress thread times it, and
+         * polling catches it if it happens before internal_done. Otherwise we only learn here that they
+         * arrived, and can't tell how much of the transfer the library did behind updateInternal. */
+        if (progress == THREAD_PROGRESS)
+            overlapped += ((arrived < internal_done) ? arrived : internal_done) - posted;
+        else if (arrived != 0.0)
+            overlapped += arrived - posted;
+        else{
+            arrived = MPI_Wtime();
+            unseen++;
+        }
+        transfer += arrived - posted;
+
+        /* An empty halo message means the neighbor's edge didn't move: keep the halo of the last step */
+        if (tolerance >= 0.0){
+            float *halo[2][4];
+            for (x=0; x<2; x++){
+                halo[x][0] = &local[x][1][0];
+                halo[x][1] = &local[x][1][columns+1];
+                halo[x][2] = &local[x][rows+1][1];
+                halo[x][3] = &local[x][0][1];
+            }
+            for (i=0; i<4; i++){
+                if (recvfrom[i] == MPI_PROC_NULL)
+                    continue;
+                MPI_Get_count(&hstat[i], MPI_FLOAT, &count);
+                if (count == 0)
+                    copyEdge(halo[iz][i], stride[i], halo[1-iz][i], stride[i], points[i]);
+            }
+        }
 
         /// *** CALCULATION OF EXTERNAL DATA *** ///
-        updateExternal(1,rows, columns,right,left,up,down, &local[iz][0][0], &local[1-iz][0][0]);
+        if (tile > 0){
+            /* the halos of the last step are in the other local array; on the first step we know nothing */
+            float *halo[2][4];
+            for (x=0; x<2; x++){
+                halo[x][0] = &local[x][1][0];
+                halo[x][1] = &local[x][1][columns+1];
+                halo[x][2] = &local[x][rows+1][1];
+                halo[x][3] = &local[x][0][1];
+            }
+            for (i=0; i<4; i++)
+                if (recvfrom[i] == MPI_PROC_NULL)
+                    halomove[i] = 0.0;
+                else if (it == 1)
+                    halomove[i] = FLT_MAX;
+                else
+                    halomove[i] = edgeDistance(halo[iz][i], halo[1-iz][i], stride[i], points[i]);
+            updateTiles(&tiles, 1, halomove, tolerance > 0.0 ? tolerance : 0.0, rows, columns, right, left, up, down,
+                        &local[iz][0][0], &local[1-iz][0][0]);
+            float *swap = tiles.last;
+            tiles.last = tiles.now;
+            tiles.now = swap;
+        }
+        else
+            updateExternal(1,rows, columns,right,left,up,down, &local[iz][0][0], &local[1-iz][0][0]);
 
         iz = 1-iz; 
+        if (snapfile[0]){
+            MPI_File_set_view(snap, disp + (MPI_Offset)it*NXPROB*NYPROB*sizeof(float), MPI_FLOAT, sendsubarrtype, "native", MPI_INFO_NULL);
+            MPI_File_write_all(snap, &(local[iz][0][0]), 1, recvsubarrtype, &status);
+        }
 	//----------------------------------------------------------------------------------------------------------------------------------------------
 	// Here we check for convergence (SYGKLISH). In case the whole upgraded array is the same as its previous array, then
 	// we got to stop iterating because no other changes are  going to happen!
@@ -341,10 +582,10 @@ int main (int argc, char *argv[]){
 
 	//----------------------------------------------------------------------------------------------------------------------------------------------
 
-        if (right != MPI_PROC_NULL) MPI_Wait(&SRequestR , MPI_STATUS_IGNORE );
-        if (left != MPI_PROC_NULL) MPI_Wait(&SRequestL , MPI_STATUS_IGNORE );
-        if (up !=  MPI_PROC_NULL) MPI_Wait(&SRequestU , MPI_STATUS_IGNORE );
-        if (down !=  MPI_PROC_NULL) MPI_Wait(&SRequestD , MPI_STATUS_IGNORE );
+        if (progress == THREAD_PROGRESS)
+            waitFor(&prog.sent, it);
+        else
+            MPI_Waitall(4, &hreq[4], MPI_STATUSES_IGNORE);
 
 #if 0
         for ( i=0; i<numworkers; i++){
@@ -374,6 +615,14 @@ int main (int argc, char *argv[]){
     /* Stop the timer */
     finish = MPI_Wtime();
 
+    if (snapfile[0])
+        MPI_File_close(&snap);
+
+    if (progress == THREAD_PROGRESS){
+        atomic_store_explicit(&prog.step, -1, memory_order_release);
+        pthread_join(progress_thread, NULL);
+    }
+
     /* Gather it all back */
 
     /* Each worker writes to its portion of the file */
@@ -387,10 +636,28 @@ int main (int argc, char *argv[]){
     MPI_File_close(&fh);
 
     printf("Process:%d, Elapsed time: %e secs\n",taskid,finish-start);
+    if (steps > 0 && unseen == steps)
+        printf("Process:%d, Halo transfer: %e secs, overlap with updateInternal unknown (measure it with -a thread, or -r without -t)\n",
+               taskid, transfer);
+    else
+        printf("Process:%d, Halo transfer: %e secs, %.1f%%%s of it overlapped with updateInternal\n",
+               taskid, transfer, transfer > 0.0 ? 100.0*overlapped/transfer : 100.0,
+               unseen ? " or more" : "");
+    if (tolerance >= 0.0)
+        printf("Process:%d, Halo edges: %d sent, %d skipped as unchanged\n", taskid, edges_sent, edges_skipped);
+    if (rerunfile[0])
+        printf("Process:%d, Incremental rerun: %ld of %ld point updates computed\n", taskid, computed, (long)STEPS*rows*columns);
+    if (tile > 0)
+        printf("Process:%d, Active tiles: %ld of %ld point updates skipped (%.1f%%)\n", taskid, tiles.skipped, tiles.points,
+               tiles.points > 0 ? 100.0*tiles.skipped/tiles.points : 0.0);
 
     /* Free malloc'd memory */
     free2darr(&local[0]);
     free2darr(&local[1]);
+    for (i=0; i<4; i++)
+        free(lastsent[i]);
+    if (tile > 0)
+        tilesFree(&tiles);
 
     MPI_Type_free(&type);
     MPI_Type_free(&sendsubarrtype);
@@ -404,6 +671,335 @@ int main (int argc, char *argv[]){
     return 0;
 }
 
+/**************************************************************************
+ *  subroutine progressLoop
+/// body of the progress thread (-a thread). Keeps calling MPI_Testall on the
+/// halo requests of every step handed over, so they move while the compute
+/// thread is in updateInternal, and reports when they completed.
+ ****************************************************************************/
+void *progressLoop(struct Progress *p)
+{
+    int handled = 0, step, flag;
+
+    while ((step = atomic_load_explicit(&p->step, memory_order_acquire)) >= 0){
+        if (step == handled){
+            sched_yield();
+            continue;
+        }
+        for (flag = 0; !flag; sched_yield())
+            MPI_Testall(4, p->req, &flag, p->stat);
+        p->arrived = MPI_Wtime();
+        atomic_store_explicit(&p->received, step, memory_order_release);
+
+        for (flag = 0; !flag; sched_yield())
+            MPI_Testall(4, &p->req[4], &flag, MPI_STATUSES_IGNORE);
+        atomic_store_explicit(&p->sent, step, memory_order_release);
+        handled = step;
+    }
+    return NULL;
+}
+
+
+/**************************************************************************
+ *  subroutine edgeChanged
+/// returns 1 if a point of edge (n points, stride apart) moved more than
+/// tolerance from last, and then copies the edge to last for the next call
+ ****************************************************************************/
+int edgeChanged(float *edge, int stride, float *last, int n, double tolerance)
+{
+    int i;
+
+    for (i=0; i<n; i++)
+        if (fabs(edge[i*stride] - last[i]) > tolerance){
+            copyEdge(last, 1, edge, stride, n);
+            return 1;
+        }
+    return 0;
+}
+
+/**************************************************************************
+ *  subroutine copyEdge
+/// copies n points from src to dst, each with its own stride
+ ****************************************************************************/
+void copyEdge(float *dst, int dststride, float *src, int srcstride, int n)
+{
+    int i;
+
+    for (i=0; i<n; i++)
+        dst[i*dststride] = src[i*srcstride];
+}
+
+
+/**************************************************************************
+ *  subroutine edgeDistance
+/// returns the largest difference between the n points of a and b, both
+/// stride apart
+ ****************************************************************************/
+float edgeDistance(float *a, float *b, int stride, int n)
+{
+    int i;
+    float d = 0.0;
+
+    for (i=0; i<n; i++)
+        if (fabs(a[i*stride] - b[i*stride]) > d)
+            d = fabs(a[i*stride] - b[i*stride]);
+    return d;
+}
+
+/**************************************************************************
+ *  subroutines tilesInit, tilesFree
+/// cut a rows x columns block in tiles of size x size points (the last ones
+/// smaller). All tiles start as changed, so the first step updates them all.
+ ****************************************************************************/
+void tilesInit(struct Tiles *t, int size, int rows, int columns)
+{
+    int k;
+
+    t->size = size;
+    t->nr = (rows + size-1)/size;
+    t->nc = (columns + size-1)/size;
+    t->last = (float*)malloc(t->nr*t->nc*sizeof(float));
+    t->now = (float*)malloc(t->nr*t->nc*sizeof(float));
+    for (k=0; k<t->nr*t->nc; k++)
+        t->last[k] = t->now[k] = FLT_MAX;
+    t->points = t->skipped = 0;
+}
+
+void tilesFree(struct Tiles *t)
+{
+    free(t->last);
+    free(t->now);
+}
+
+/**************************************************************************
+ *  subroutine updateTiles
+/// updates the tiles of the block that lie inside (edge = 0) or touch its
+/// outer row and column (edge = 1), skipping those whose neighborhood moved
+/// at most tolerance in the previous step. The edge tiles also look at
+/// halomove, the change of the halos by receive (left, right, down, up).
+/// A skipped tile copies u1 to u2 once, so both arrays hold its values.
+ ****************************************************************************/
+void updateTiles(struct Tiles *t, int edge, float *halomove, double tolerance, int rows, int columns,
+                 int right, int left, int up, int down, float *u1, float *u2)
+{
+    int a, b, k, ix, x0, x1, y0, y1;
+    float move;
+
+    for (a=0; a<t->nr; a++)
+        for (b=0; b<t->nc; b++){
+            x0 = 1 + a*t->size;
+            x1 = (x0 + t->size-1 < rows) ? x0 + t->size-1 : rows;
+            y0 = 1 + b*t->size;
+            y1 = (y0 + t->size-1 < columns) ? y0 + t->size-1 : columns;
+            if ((x0 == 1 || x1 == rows || y0 == 1 || y1 == columns) != edge)
+                continue;
+
+            /* the points on the boundary of the whole grid stay at their initial values */
+            if (x0 == 1 && up == MPI_PROC_NULL)
+                x0 = 2;
+            if (x1 == rows && down == MPI_PROC_NULL)
+                x1 = rows-1;
+            if (y0 == 1 && left == MPI_PROC_NULL)
+                y0 = 2;
+            if (y1 == columns && right == MPI_PROC_NULL)
+                y1 = columns-1;
+            k = a*t->nc + b;
+            if (x0 > x1 || y0 > y1){
+                t->now[k] = 0.0;
+                continue;
+            }
+
+            move = t->last[k];
+            if (a > 0 && t->last[k-t->nc] > move)
+                move = t->last[k-t->nc];
+            if (a < t->nr-1 && t->last[k+t->nc] > move)
+                move = t->last[k+t->nc];
+            if (b > 0 && t->last[k-1] > move)
+                move = t->last[k-1];
+            if (b < t->nc-1 && t->last[k+1] > move)
+                move = t->last[k+1];
+            if (edge){
+                if (y0 == 1 && halomove[0] > move)
+                    move = halomove[0];
+                if (y1 == columns && halomove[1] > move)
+                    move = halomove[1];
+                if (x1 == rows && halomove[2] > move)
+                    move = halomove[2];
+                if (x0 == 1 && halomove[3] > move)
+                    move = halomove[3];
+            }
+
+            t->points += (x1-x0+1)*(y1-y0+1);
+            if (move > tolerance)
+                t->now[k] = updateRegion(x0, x1, y0, y1, columns, u1, u2);
+            else{
+                if (t->last[k] > 0.0)
+                    for (ix = x0; ix <= x1; ix++)
+                        memcpy(u2+ix*(columns+2)+y0, u1+ix*(columns+2)+y0, (y1-y0+1)*sizeof(float));
+                t->now[k] = 0.0;
+                t->skipped += (x1-x0+1)*(y1-y0+1);
+            }
+        }
+}
+
+/**************************************************************************
+ *  subroutine updateRegion
+/// updates the points x0..x1, y0..y1 of a block of ny columns like
+/// updateInternal, and returns the largest change of a point
+ ****************************************************************************/
+float updateRegion(int x0, int x1, int y0, int y1, int ny, float *u1, float *u2)
+{
+    int ix, iy;
+    float change = 0.0;
+
+    for (ix = x0; ix <= x1; ix++)
+        for (iy = y0; iy <= y1; iy++){
+            *(u2+ix*(ny+2)+iy) = *(u1+ix*(ny+2)+iy)  +
+                             parms.cx * (*(u1+(ix+1)*(ny+2)+iy) +
+                             *(u1+(ix-1)*(ny+2)+iy) -
+                             2.0 * *(u1+ix*(ny+2)+iy)) +
+                             parms.cy * (*(u1+ix*(ny+2)+iy+1) +
+                             *(u1+ix*(ny+2)+iy-1) -
+                             2.0 * *(u1+ix*(ny+2)+iy));
+            if (fabs(*(u2+ix*(ny+2)+iy) - *(u1+ix*(ny+2)+iy)) > change)
+                change = fabs(*(u2+ix*(ny+2)+iy) - *(u1+ix*(ny+2)+iy));
+        }
+    return change;
+}
+
+/**************************************************************************
+ *  subroutine rerun
+/// does the STEPS steps for an input that differs from the input of a run
+/// with -S in a few points, reusing the grids that run saved in snapfile.
+/// A step changes a point only through its four neighbors, so after step t
+/// the grids can only differ within t points of the changed ones (the
+/// cone). Every step we compute the cone and take the points around it,
+/// whose neighbors it needs, from the snapshot of the previous step; at the
+/// end the points outside the cone come from the last snapshot.
+/// The block is rows x columns with its point 1,1 at the global point gx,gy,
+/// and req are the persistent halo requests of both domains. Returns the
+/// domain with the result and adds the point updates done to computed.
+ ****************************************************************************/
+int rerun(const char *snapfile, float **local[2], int rows, int columns, int gx, int gy, MPI_Request *req, long *computed)
+{
+    MPI_File fh;
+    int ix, iy, it, iz = 0, taskid,
+        box[4] = {NXPROB, -1, NYPROB, -1},      /* changed points: first and last row, first and last column */
+        all[4],
+        block[4] = {gx, gx+rows-1, gy, gy+columns-1},
+        inner[4] = {1, NXPROB-2, 1, NYPROB-2},  /* the points that change, inside the fixed boundary */
+        in[4], out[4];
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    MPI_File_open(MPI_COMM_WORLD, (char*)snapfile, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+
+    /* Diff of the input against frame 0, read into the other domain. That one then goes back to 0's like in
+     * a full run: the fixed boundary points are never computed, so in the cone they keep what main gave them. */
+    readFrame(fh, 0, gx, gy, block, NULL, columns, &local[1][0][0]);
+    for (ix=1; ix<=rows; ix++)
+        for (iy=1; iy<=columns; iy++)
+            if (local[0][ix][iy] != local[1][ix][iy]){
+                box[0] = (gx+ix-1 < box[0]) ? gx+ix-1 : box[0];
+                box[1] = (gx+ix-1 > box[1]) ? gx+ix-1 : box[1];
+                box[2] = (gy+iy-1 < box[2]) ? gy+iy-1 : box[2];
+                box[3] = (gy+iy-1 > box[3]) ? gy+iy-1 : box[3];
+            }
+    all[0] = -box[0]; all[1] = box[1]; all[2] = -box[2]; all[3] = box[3];
+    MPI_Allreduce(MPI_IN_PLACE, all, 4, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    box[0] = -all[0]; box[1] = all[1]; box[2] = -all[2]; box[3] = all[3];
+    memset(&local[1][0][0], 0, (rows+2)*(columns+2)*sizeof(float));
+    if (taskid == MASTER){
+        if (box[0] > box[1])
+            printf("The input is the one of %s: the result is its last step.\n", snapfile);
+        else
+            printf("The input differs from the one of %s in rows %d-%d, columns %d-%d.\n", snapfile, box[0], box[1], box[2], box[3]);
+    }
+
+    for (it = 1; it <= STEPS; it++){
+        /* the points of step it-1 the cone of step it reads that the cone of step it-1 didn't compute */
+        if (it > 1){
+            cone(out, box, it+1, block, NULL);
+            cone(in, box, it-1, block, NULL);
+            readFrame(fh, it-1, gx, gy, out, in, columns, &local[iz][0][0]);
+        }
+        MPI_Startall(8, &req[iz*8]);
+        MPI_Waitall(8, &req[iz*8], MPI_STATUSES_IGNORE);
+
+        cone(out, box, it, block, inner);
+        if (out[0] <= out[1] && out[2] <= out[3]){
+            updateRegion(out[0]-gx+1, out[1]-gx+1, out[2]-gy+1, out[3]-gy+1, columns, &local[iz][0][0], &local[1-iz][0][0]);
+            *computed += (long)(out[1]-out[0]+1)*(out[3]-out[2]+1);
+        }
+        iz = 1-iz;
+    }
+
+    /* Outside the cone the result is the one of the baseline */
+    cone(in, box, STEPS, block, NULL);
+    readFrame(fh, STEPS, gx, gy, block, in, columns, &local[iz][0][0]);
+    MPI_File_close(&fh);
+    return iz;
+}
+
+/**************************************************************************
+ *  subroutine cone
+/// sets r to the points within t of box (first and last row, first and
+/// last column, all global), clipped to block and, if not NULL, to inner.
+/// An empty box gives an empty r.
+ ****************************************************************************/
+void cone(int r[4], const int box[4], int t, const int block[4], const int inner[4])
+{
+    int k;
+
+    for (k=0; k<4; k++)
+        r[k] = box[k] + ((k%2) ? t : -t);
+    if (box[0] > box[1])
+        r[0] = r[2] = 1, r[1] = r[3] = 0;
+    for (k=0; k<4; k+=2){
+        r[k] = (r[k] > block[k]) ? r[k] : block[k];
+        r[k+1] = (r[k+1] < block[k+1]) ? r[k+1] : block[k+1];
+        if (inner){
+            r[k] = (r[k] > inner[k]) ? r[k] : inner[k];
+            r[k+1] = (r[k+1] < inner[k+1]) ? r[k+1] : inner[k+1];
+        }
+    }
+}
+
+/**************************************************************************
+ *  subroutine readFrame
+/// reads the points of out but not of in (global rectangles, in may be NULL
+/// or empty) of snapshot frame into u, a block of ny columns with its
+/// point 1,1 at the global point gx,gy
+ ****************************************************************************/
+void readFrame(MPI_File fh, int frame, int gx, int gy, const int out[4], const int in[4], int ny, float *u)
+{
+    int ix, y[4], k;
+
+    for (ix = out[0]; ix <= out[1]; ix++){
+        /* the row, or the parts of it left and right of in */
+        y[0] = out[2]; y[1] = out[3]; y[2] = 1; y[3] = 0;
+        if (in && in[2] <= in[3] && ix >= in[0] && ix <= in[1]){
+            y[1] = in[2]-1;
+            y[2] = in[3]+1;
+            y[3] = out[3];
+        }
+        for (k=0; k<4; k+=2)
+            if (y[k] <= y[k+1])
+                MPI_File_read_at(fh, (((MPI_Offset)frame*NXPROB + ix)*NYPROB + y[k])*sizeof(float),
+                                 u + (ix-gx+1)*(ny+2) + y[k]-gy+1, y[k+1]-y[k]+1, MPI_FLOAT, MPI_STATUS_IGNORE);
+    }
+}
+
+/**************************************************************************
+ *  subroutine waitFor
+/// spins until counter reaches step
+ ****************************************************************************/
+void waitFor(atomic_int *counter, int step)
+{
+    while (atomic_load_explicit(counter, memory_order_acquire) < step)
+        sched_yield();
+}
+
+
 /**************************************************************************
  *  subroutine update
 /// gets start = 2, end = xdim-1, ny = ydim = number of block columns without 
@@ -597,6 +1193,19 @@ int checkSize(const char *filename){
     return sz == NYPROB*NXPROB*sizeof(float);
 }
 
+//returns 1 when filename holds the grids of the STEPS+1 steps of a run with -S
+int checkSnapshots(const char *filename){
+    FILE *fp;
+    fp = fopen(filename, "rb");
+    if(!fp)
+        return 0;
+    fseek(fp, 0L, SEEK_END);
+    long int sz = ftell(fp);
+    fclose(fp);
+
+    return sz == (STEPS+1)*NYPROB*NXPROB*sizeof(float);
+}
+
 int malloc2darr(float ***array, int n, int m) {
 
     /* allocate the n*m contiguous items */
@@ -0,0 +1,269 @@
+/****************************************************************************
+ * FILE: shm_heat2D.cpp
+ * DESCRIPTIONS:  
+ *   HEAT2D Example - Shared memory C++ Version
+ *   Same stencil as the MPI versions, for runs that fit in the memory of one
+ *   node. There are no ranks, no halo messages and no datatypes: all threads
+ *   update one global grid. As in the MPI versions, an array containing two
+ *   domains is used; these domains alternate between old data and new data.
+ *
+ *   The inner part of the grid is split into tiles. At every time step each
+ *   thread starts with the same contiguous range of tiles (so the tiles stay
+ *   on the core that touched them first) and, when it runs out of work, it
+ *   steals tiles from the end of another thread's range.
+ *
+ *   The input and output files are binary NXPROB x NYPROB float grids, the
+ *   same as the ones of MPI+Pio (see grid_generator.c).
+ * AUTHORS: Costas Pitharoulios, Simon Iyamu
+ *   
+ ****************************************************************************/
+
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <latch>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define NXPROB      80                 /* x dimension of problem grid */
+#define NYPROB      64                 /* y dimension of problem grid */
+#define STEPS       100                /* default number of time steps */
+#define TILEX       32                 /* default rows of a tile */
+#define TILEY       256                /* default columns of a tile */
+
+struct Parms { 
+  float cx;
+  float cy;
+} parms = {0.1, 0.1};
+
+/* Range [head, tail) of tile numbers that one thread still has to do in this step.
+ * Both ends are packed in one word, so the owner (taking from the head) and the
+ * thieves (taking from the tail) agree on every tile with a single CAS. */
+struct alignas(64) TileQueue {
+    std::atomic<uint64_t> range;
+
+    static uint64_t pack(uint32_t head, uint32_t tail) { return ((uint64_t)head << 32) | tail; }
+
+    void reset(uint32_t head, uint32_t tail) { range.store(pack(head, tail), std::memory_order_relaxed); }
+
+    /* Owner side: takes the first tile of the range */
+    bool pop(uint32_t &tile) {
+        uint64_t r = range.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t head = r >> 32, tail = (uint32_t)r;
+            if (head >= tail)
+                return false;
+            if (range.compare_exchange_weak(r, pack(head+1, tail), std::memory_order_relaxed)) {
+                tile = head;
+                return true;
+            }
+        }
+    }
+
+    /* Thief side: takes the last tile of the range */
+    bool steal(uint32_t &tile) {
+        uint64_t r = range.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t head = r >> 32, tail = (uint32_t)r;
+            if (head >= tail)
+                return false;
+            if (range.compare_exchange_weak(r, pack(head, tail-1), std::memory_order_relaxed)) {
+                tile = tail-1;
+                return true;
+            }
+        }
+    }
+};
+
+static int checkSize(const char *filename);
+static void updateTile(int x0, int x1, int y0, int y1, const float *u1, float *u2);
+
+int main(int argc, char *argv[]){
+    int thread_count = std::thread::hardware_concurrency(),
+        steps = STEPS,
+        tilex = TILEX, tiley = TILEY,    /* size of a tile */
+        i;
+    char inputfile[80] = "initial.dat";
+    char outputfile[80] = "final.dat";
+
+    /* Read arguments */
+    for(i=1; i<argc-1; i++){
+        if(!strcmp(argv[i],"-i"))
+            strcpy(inputfile,argv[i+1]);
+        if(!strcmp(argv[i],"-o"))
+            strcpy(outputfile,argv[i+1]);
+        if(!strcmp(argv[i],"-t"))
+            thread_count = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-k"))
+            steps = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-x"))
+            tilex = strtol(argv[i+1], NULL, 10);
+        if(!strcmp(argv[i],"-y"))
+            tiley = strtol(argv[i+1], NULL, 10);
+    }
+    if (thread_count <= 0 || steps <= 0 || tilex <= 0 || tiley <= 0){
+        printf("ERROR: wrong number of threads, steps or tile size!\n");
+        exit(22);
+    }
+    if (!checkSize(inputfile)){
+        printf("ERROR: grid size of input file is diffrent that the definitions of NXPROB, NYPROB or file doesn't exist\n");
+        exit(22);
+    }
+
+    /* The tiles cover the inner part of the grid; the boundary is held fixed */
+    int tiles_x = (NXPROB-2 + tilex-1) / tilex,
+        tiles_y = (NYPROB-2 + tiley-1) / tiley,
+        ntiles = tiles_x * tiles_y;
+
+    printf("Starting shm_heat2D with %d threads.\n", thread_count);
+    printf("Grid size: X= %d  Y= %d  Time steps= %d\n",NXPROB,NYPROB,steps);
+    printf("The grid will part into a %d x %d tile grid of %d x %d tiles.\n",tiles_x,tiles_y,tilex,tiley);
+
+    /* Read the grid */
+    std::vector<float> grid((size_t)NXPROB*NYPROB);
+    FILE *fp = fopen(inputfile, "rb");
+    if (!fp || fread(grid.data(), sizeof(float), grid.size(), fp) != grid.size()){
+        printf("ERROR: couldn't read %s\n", inputfile);
+        exit(22);
+    }
+    fclose(fp);
+
+    /* The two domains are left uninitialized, so that every thread touches its own tiles first */
+    std::unique_ptr<float[]> u[2] = {std::make_unique_for_overwrite<float[]>(grid.size()),
+                                     std::make_unique_for_overwrite<float[]>(grid.size())};
+
+    /* Every thread owns the same contiguous range of tiles at every step */
+    std::vector<uint32_t> first(thread_count+1);
+    for (i=0; i<=thread_count; i++)
+        first[i] = (uint64_t)i*ntiles/thread_count;
+
+    std::vector<TileQueue> queue(thread_count);
+    for (i=0; i<thread_count; i++)
+        queue[i].reset(first[i], first[i+1]);
+
+    std::atomic<long> stolen{0};
+    std::latch touched(thread_count);
+    int iz = 0;
+
+    /* When the last thread arrives, the domains are swapped and the ranges are given back to their owners */
+    std::barrier step_done(thread_count, [&]() noexcept {
+        iz = 1-iz;
+        for (int t=0; t<thread_count; t++)
+            queue[t].reset(first[t], first[t+1]);
+    });
+
+    auto tileBounds = [&](uint32_t tile, int &x0, int &x1, int &y0, int &y1){
+        x0 = 1 + (tile / tiles_y) * tilex;
+        y0 = 1 + (tile % tiles_y) * tiley;
+        x1 = std::min(x0 + tilex - 1, NXPROB-2);
+        y1 = std::min(y0 + tiley - 1, NYPROB-2);
+    };
+
+    auto worker = [&](int tid){
+        int x0, x1, y0, y1, it, ix;
+        uint32_t tile;
+        long mystolen = 0;
+
+        /* First touch of the own tiles */
+        for (tile = first[tid]; tile < first[tid+1]; tile++){
+            tileBounds(tile, x0, x1, y0, y1);
+            for (ix = x0; ix <= x1; ix++){
+                memcpy(&u[0][ix*NYPROB+y0], &grid[ix*NYPROB+y0], (y1-y0+1)*sizeof(float));
+                memcpy(&u[1][ix*NYPROB+y0], &grid[ix*NYPROB+y0], (y1-y0+1)*sizeof(float));
+            }
+        }
+        touched.arrive_and_wait();
+
+        /// *** WORK STARTS HERE *** ///
+        for (it = 1; it <= steps; it++){
+            const float *u1 = u[iz].get();
+            float *u2 = u[1-iz].get();
+
+            /* Own tiles first, then help the others */
+            while (queue[tid].pop(tile)){
+                tileBounds(tile, x0, x1, y0, y1);
+                updateTile(x0, x1, y0, y1, u1, u2);
+            }
+            for (int v = 1; v < thread_count; v++){
+                TileQueue &victim = queue[(tid+v) % thread_count];
+                while (victim.steal(tile)){
+                    tileBounds(tile, x0, x1, y0, y1);
+                    updateTile(x0, x1, y0, y1, u1, u2);
+                    mystolen++;
+                }
+            }
+            step_done.arrive_and_wait();
+        }
+        stolen += mystolen;
+    };
+
+    /* The boundary of the grid is not covered by any tile */
+    for (i=0; i<NXPROB; i++){
+        for (int j=0; j<NYPROB; j++){
+            if (i == 0 || i == NXPROB-1 || j == 0 || j == NYPROB-1)
+                u[0][i*NYPROB+j] = u[1][i*NYPROB+j] = grid[i*NYPROB+j];
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (i=1; i<thread_count; i++)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (auto &t : threads)
+        t.join();
+    auto finish = std::chrono::steady_clock::now();
+    /// *** WORK COMPLETE *** ///
+
+    printf("Elapsed time: %e secs, %ld of %ld tiles stolen\n",
+           std::chrono::duration<double>(finish-start).count(), stolen.load(), (long)ntiles*steps);
+
+    /* Write the grid */
+    fp = fopen(outputfile, "wb");
+    if (!fp || fwrite(u[iz].get(), sizeof(float), grid.size(), fp) != grid.size()){
+        printf("ERROR: couldn't write %s\n", outputfile);
+        exit(22);
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+/**************************************************************************
+ *  subroutine updateTile
+/// updates the rectangle [x0,x1] x [y0,y1] (inclusive) of the grid
+ ****************************************************************************/
+static void updateTile(int x0, int x1, int y0, int y1, const float *u1, float *u2)
+{
+   int ix, iy;
+   for (ix = x0; ix <= x1; ix++){ 
+      for (iy = y0; iy <= y1; iy++){
+         *(u2+ix*NYPROB+iy) = *(u1+ix*NYPROB+iy)  + 
+                          parms.cx * (*(u1+(ix+1)*NYPROB+iy) +
+                          *(u1+(ix-1)*NYPROB+iy) - 
+                          2.0 * *(u1+ix*NYPROB+iy)) +
+                          parms.cy * (*(u1+ix*NYPROB+iy+1) +
+                         *(u1+ix*NYPROB+iy-1) - 
+                          2.0 * *(u1+ix*NYPROB+iy));
+       }
+    }
+}
+
+/* Checks if grid size of given file is the same as NXPROB x NYPROB */
+static int checkSize(const char *filename){
+    FILE *fp;
+    fp = fopen(filename, "rb");
+    if(!fp)
+        return 0;
+    fseek(fp, 0L, SEEK_END);
+    long int sz = ftell(fp);
+    fclose(fp);
+
+    return sz == NYPROB*NXPROB*sizeof(float);
+}
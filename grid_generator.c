@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifndef NXPROB                         /* may be given with -D, see MPI+Pio/bench_layout.sh */
 #define NXPROB      80                 /* x dimension of problem grid */
+#endif
+#ifndef NYPROB
 #define NYPROB      64                 /* y dimension of problem grid */
+#endif
 
 int main(int argc, char *argv[]){
     void inidat(), prtdat();
-    float  u[2][NXPROB][NYPROB];        /* array for grid */
+    static float  u[2][NXPROB][NYPROB]; /* array for grid, too big for the stack on large grids */
     int	taskid,                     /* this task's unique id */
 	numworkers,                 /* number of worker processes */
 	numtasks,                   /* number of tasks */